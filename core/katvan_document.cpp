@@ -52,6 +52,11 @@ void Document::setDocumentText(const QString& text)
     Q_EMIT contentReset();
 }
 
+void Document::setContentModifiedDelay(int msecs)
+{
+    d_debounceTimer->setInterval(msecs);
+}
+
 void Document::propagateDocumentEdit(int from, int charsRemoved, int charsAdded)
 {
     if (d_suppressContentChangeHandling) {
@@ -96,6 +96,7 @@ public:
 
 public slots:
     void setDocumentText(const QString& text);
+    void setContentModifiedDelay(int msecs);
 
 private slots:
     void propagateDocumentEdit(int from, int charsRemoved, int charsAdded);
@@ -0,0 +1,145 @@
+/*
+ * This file is part of Katvan
+ * Copyright (c) 2024 - 2026 Igor Khanin
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "katvan_document.h"
+#include "katvan_documentregistry.h"
+#include "katvan_typstdriverwrapper.h"
+
+#include <QFileInfo>
+
+namespace katvan {
+
+DocumentRegistry& DocumentRegistry::instance()
+{
+    static DocumentRegistry registry;
+    return registry;
+}
+
+void DocumentRegistry::addWindow(Document* document, TypstDriverWrapper* driver)
+{
+    if (findWindow(document) != nullptr) {
+        return;
+    }
+    d_windows.append(Window { document, driver, QString() });
+
+    connect(document, &Document::contentEdited, this, [this, document](int from, int to, QString text) {
+        documentEdited(document, from, to, text);
+    });
+    connect(document, &Document::contentModified, this, [this, document]() {
+        documentModified(document);
+    });
+    connect(document, &QObject::destroyed, this, [this, document]() {
+        removeWindow(document);
+    });
+}
+
+void DocumentRegistry::removeWindow(Document* document)
+{
+    Window* window = findWindow(document);
+    if (window == nullptr) {
+        return;
+    }
+
+    QString filePath = window->filePath;
+    d_windows.removeIf([document](const Window& w) { return w.document == document; });
+    disconnect(document, nullptr, this, nullptr);
+
+    // Other windows go back to the content saved on disk
+    if (!filePath.isEmpty()) {
+        for (const Window& other : std::as_const(d_windows)) {
+            other.driver->closeFile(filePath);
+            other.driver->updatePreview();
+        }
+    }
+}
+
+void DocumentRegistry::setFilePath(Document* document, const QString& filePath)
+{
+    Window* window = findWindow(document);
+    if (window == nullptr) {
+        return;
+    }
+
+    // Paths are compared by the engines, so must be in the same form for
+    // every window
+    QFileInfo info { filePath };
+    QString canonicalPath = info.exists() ? info.canonicalFilePath() : filePath;
+
+    QString previousPath = window->filePath;
+    window->filePath = canonicalPath;
+
+    for (const Window& other : std::as_const(d_windows)) {
+        if (other.document == document) {
+            continue;
+        }
+
+        if (!previousPath.isEmpty() && previousPath != canonicalPath) {
+            other.driver->closeFile(previousPath);
+        }
+        if (!canonicalPath.isEmpty()) {
+            other.driver->setFileSource(canonicalPath, document->textForPreview());
+        }
+        other.driver->updatePreview();
+
+        // The window's own driver was reset, and needs everything again
+        if (!other.filePath.isEmpty()) {
+            window->driver->setFileSource(other.filePath, other.document->textForPreview());
+        }
+    }
+}
+
+DocumentRegistry::Window* DocumentRegistry::findWindow(Document* document)
+{
+    for (Window& window : d_windows) {
+        if (window.document == document) {
+            return &window;
+        }
+    }
+    return nullptr;
+}
+
+void DocumentRegistry::documentEdited(Document* document, int from, int to, const QString& text)
+{
+    Window* window = findWindow(document);
+    if (window == nullptr || window->filePath.isEmpty()) {
+        return;
+    }
+
+    for (const Window& other : std::as_const(d_windows)) {
+        if (other.document != document) {
+            other.driver->applyFileContentEdit(window->filePath, from, to, text);
+        }
+    }
+}
+
+void DocumentRegistry::documentModified(Document* document)
+{
+    Window* window = findWindow(document);
+    if (window == nullptr || window->filePath.isEmpty()) {
+        return;
+    }
+
+    for (const Window& other : std::as_const(d_windows)) {
+        if (other.document != document) {
+            other.driver->updatePreview();
+        }
+    }
+}
+
+}
+
+#include "moc_katvan_documentregistry.cpp"
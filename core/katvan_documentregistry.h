@@ -0,0 +1,68 @@
+/*
+ * This file is part of Katvan
+ * Copyright (c) 2024 - 2026 Igor Khanin
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <QList>
+#include <QObject>
+#include <QString>
+
+namespace katvan {
+
+class Document;
+class TypstDriverWrapper;
+
+/**
+ * Tracks the documents open in all windows of the application, and gives
+ * each window's driver the unsaved content of the documents open in the
+ * others. Editing a chapter in one window then recompiles the window of the
+ * document including it right away, without saving the chapter first.
+ */
+class DocumentRegistry : public QObject
+{
+    Q_OBJECT
+
+public:
+    static DocumentRegistry& instance();
+
+    void addWindow(Document* document, TypstDriverWrapper* driver);
+    void removeWindow(Document* document);
+
+    /**
+     * Must be called whenever the window's driver is reset to a new input
+     * file, as the new engine has none of the other documents' content.
+     */
+    void setFilePath(Document* document, const QString& filePath);
+
+private:
+    struct Window
+    {
+        Document* document;
+        TypstDriverWrapper* driver;
+        QString filePath;
+    };
+
+    DocumentRegistry() = default;
+
+    Window* findWindow(Document* document);
+    void documentEdited(Document* document, int from, int to, const QString& text);
+    void documentModified(Document* document);
+
+    QList<Window> d_windows;
+};
+
+}
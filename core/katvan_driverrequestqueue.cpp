@@ -0,0 +1,94 @@
+/*
+ * This file is part of Katvan
+ * Copyright (c) 2024 - 2026 Igor Khanin
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "katvan_driverrequestqueue.h"
+
+#include <QMutexLocker>
+
+namespace katvan {
+
+void DriverRequestQueue::push(Priority priority, Job job, const QString& key)
+{
+    QMutexLocker locker { &d_mutex };
+
+    QList<Request>& requests = d_requests[static_cast<size_t>(priority)];
+    if (!key.isEmpty()) {
+        requests.removeIf([&key](const Request& request) { return request.key == key; });
+    }
+    requests.append(Request { key, std::move(job), d_nextSequence++ });
+}
+
+bool DriverRequestQueue::remove(Priority priority, const QString& key)
+{
+    QMutexLocker locker { &d_mutex };
+
+    QList<Request>& requests = d_requests[static_cast<size_t>(priority)];
+    return requests.removeIf([&key](const Request& request) { return request.key == key; }) > 0;
+}
+
+void DriverRequestQueue::clear()
+{
+    QMutexLocker locker { &d_mutex };
+
+    for (QList<Request>& requests : d_requests) {
+        requests.clear();
+    }
+}
+
+DriverRequestQueue::Job DriverRequestQueue::takeNext()
+{
+    QMutexLocker locker { &d_mutex };
+
+    QList<Request>& stateRequests = d_requests[static_cast<size_t>(Priority::STATE)];
+    QList<Request>& interactiveRequests = d_requests[static_cast<size_t>(Priority::INTERACTIVE)];
+    if (!stateRequests.isEmpty() && !interactiveRequests.isEmpty()
+        && interactiveRequests.first().sequence < stateRequests.first().sequence) {
+        return interactiveRequests.takeFirst().job;
+    }
+
+    for (QList<Request>& requests : d_requests) {
+        if (!requests.isEmpty()) {
+            return requests.takeFirst().job;
+        }
+    }
+    return Job();
+}
+
+bool DriverRequestQueue::runNext()
+{
+    // Run without holding the lock, so requests can be pushed meanwhile
+    Job job = takeNext();
+    if (!job) {
+        return false;
+    }
+
+    job();
+    return true;
+}
+
+qsizetype DriverRequestQueue::size() const
+{
+    QMutexLocker locker { &d_mutex };
+
+    qsizetype result = 0;
+    for (const QList<Request>& requests : d_requests) {
+        result += requests.size();
+    }
+    return result;
+}
+
+}
@@ -0,0 +1,74 @@
+/*
+ * This file is part of Katvan
+ * Copyright (c) 2024 - 2026 Igor Khanin
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <QList>
+#include <QMutex>
+#include <QString>
+
+#include <array>
+#include <functional>
+
+namespace katvan {
+
+/**
+ * Thread safe queue of requests to the Typst driver. Requests are taken
+ * by priority, and in order of arrival within the same priority. The one
+ * exception is that interactive queries and source edits are kept in their
+ * relative order, as query positions only make sense for the source state
+ * they were made in. A request pushed with a key replaces an older request
+ * with the same key and priority that did not run yet, so superseded queries
+ * are never handled.
+ */
+class DriverRequestQueue
+{
+public:
+    enum class Priority {
+        STATE = 0,    // Source edits and settings, which every later request must see
+        INTERACTIVE,  // Completions, tooltips and other queries the user waits for
+        RENDER,       // Rendering of visible preview pages
+        COMPILE,      // Compilation and export
+        BACKGROUND,   // Metadata, word counts, prefetching of preview pages
+    };
+    static constexpr size_t PRIORITY_COUNT = 5;
+
+    using Job = std::function<void()>;
+
+    void push(Priority priority, Job job, const QString& key = QString());
+    bool remove(Priority priority, const QString& key);
+    void clear();
+
+    Job takeNext();
+    bool runNext();
+
+    qsizetype size() const;
+
+private:
+    struct Request
+    {
+        QString key;
+        Job job;
+        quint64 sequence;
+    };
+
+    mutable QMutex d_mutex;
+    quint64 d_nextSequence = 0;
+    std::array<QList<Request>, PRIORITY_COUNT> d_requests;
+};
+
+}
@@ -0,0 +1,77 @@
+/*
+ * This file is part of Katvan
+ * Copyright (c) 2024 - 2026 Igor Khanin
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "katvan_editbatch.h"
+
+namespace katvan {
+
+/**
+ * Add an edit to the batch. Returns true if it was merged into the last
+ * edit instead of being added as a separate one.
+ */
+bool EditBatch::append(const Edit& edit)
+{
+    if (!d_edits.isEmpty()) {
+        Edit& last = d_edits.last();
+        if (last.filePath == edit.filePath && mergeEdits(last, edit)) {
+            return true;
+        }
+    }
+    d_edits.append(edit);
+    return false;
+}
+
+QList<EditBatch::Edit> EditBatch::take()
+{
+    QList<Edit> edits;
+    edits.swap(d_edits);
+    return edits;
+}
+
+void EditBatch::clear()
+{
+    d_edits.clear();
+}
+
+/**
+ * Try to combine two consecutive edits of the same file into one, which is
+ * possible if the second edit's range touches the text inserted by the
+ * first. Applying the combined edit has the same result as applying both.
+ */
+bool EditBatch::mergeEdits(Edit& edit, const Edit& next)
+{
+    // Positions of the second edit are after the first was applied, where
+    // the first edit's inserted text spans [from, insertedEnd).
+    qsizetype insertedEnd = edit.from + edit.text.size();
+    if (next.from > insertedEnd || next.to < edit.from) {
+        return false;
+    }
+
+    qsizetype keepBefore = qMax(0, next.from - edit.from);
+    qsizetype keepAfter = qMax<qsizetype>(0, insertedEnd - next.to);
+    edit.text = edit.text.first(keepBefore) + next.text + edit.text.last(keepAfter);
+
+    // Text removed by the second edit past the first one's insertion was
+    // not touched by the first edit, so maps back by its size change.
+    if (next.to > insertedEnd) {
+        edit.to += static_cast<int>(next.to - insertedEnd);
+    }
+    edit.from = qMin(edit.from, next.from);
+    return true;
+}
+
+}
@@ -0,0 +1,57 @@
+/*
+ * This file is part of Katvan
+ * Copyright (c) 2024 - 2026 Igor Khanin
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <QList>
+#include <QString>
+
+namespace katvan {
+
+/**
+ * Source edits collected to be handed to the Typst driver together. Large
+ * pastes and replace-all operations emit a separate edit for each changed
+ * block, and an edit that touches the text inserted by the one before it
+ * is merged into it. Edits at unrelated positions are kept separate, as
+ * merging them would mean resending all the text in between.
+ */
+class EditBatch
+{
+public:
+    struct Edit
+    {
+        int from;
+        int to;
+        QString text;
+        QString filePath; // Empty for the main source
+    };
+
+    bool isEmpty() const { return d_edits.isEmpty(); }
+    qsizetype size() const { return d_edits.size(); }
+    const QList<Edit>& edits() const { return d_edits; }
+
+    bool append(const Edit& edit);
+    QList<Edit> take();
+    void clear();
+
+    static bool mergeEdits(Edit& edit, const Edit& next);
+
+private:
+    QList<Edit> d_edits;
+};
+
+}
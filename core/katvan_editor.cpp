@@ -22,6 +22,7 @@
 #include "katvan_document.h"
 #include "katvan_editor.h"
 #include "katvan_editorlayout.h"
+#include "katvan_editorprofiler.h"
 #include "katvan_editortooltip.h"
 #include "katvan_highlighter.h"
 #include "katvan_spellchecker.h"
@@ -33,8 +34,14 @@
 #include <QRegularExpression>
 #include <QScrollBar>
 #include <QShortcut>
+#include <QStaticText>
+#include <QStyle>
 #include <QTextBlock>
 #include <QTimer>
+#include <QtMath>
+
+#include <algorithm>
+#include <array>
 
 namespace katvan {
 
@@ -81,21 +88,91 @@ public:
         return QSize(d_editor->lineNumberGutterWidth(), 0);
     }
 
+    void drawLineNumber(QPainter& painter, const QRectF& rect, Qt::Alignment alignment, int number, bool bold)
+    {
+        const DigitGlyphs& glyphs = digitGlyphs(bold);
+        QString text = QString::number(number);
+
+        qreal width = 0;
+        for (QChar ch : std::as_const(text)) {
+            width += glyphs.advances[ch.digitValue()];
+        }
+
+        alignment = QStyle::visualAlignment(painter.layoutDirection(), alignment);
+        qreal x = (alignment & Qt::AlignRight) ? rect.right() - width : rect.left();
+
+        painter.setFont(glyphs.font);
+        for (QChar ch : std::as_const(text)) {
+            int digit = ch.digitValue();
+            painter.drawStaticText(QPointF(x, rect.top()), glyphs.digits[digit]);
+            x += glyphs.advances[digit];
+        }
+    }
+
 protected:
     void paintEvent(QPaintEvent *event) override
     {
         d_editor->lineNumberGutterPaintEvent(this, event);
     }
 
+    void changeEvent(QEvent *event) override
+    {
+        if (event->type() == QEvent::FontChange) {
+            d_regularDigits.reset();
+            d_boldDigits.reset();
+        }
+        QWidget::changeEvent(event);
+    }
+
 private:
+    // Line numbers are made of only ten different glyphs, so there is no
+    // point in shaping each number from scratch on every paint.
+    struct DigitGlyphs {
+        QFont font;
+        std::array<QStaticText, 10> digits;
+        std::array<qreal, 10> advances;
+    };
+
+    const DigitGlyphs& digitGlyphs(bool bold)
+    {
+        std::optional<DigitGlyphs>& glyphs = bold ? d_boldDigits : d_regularDigits;
+        if (!glyphs) {
+            glyphs.emplace();
+            glyphs->font = font();
+            if (bold) {
+                glyphs->font.setWeight(QFont::ExtraBold);
+            }
+
+            QFontMetricsF metrics { glyphs->font };
+            for (int digit = 0; digit < 10; digit++) {
+                QString text = QString::number(digit);
+                glyphs->digits[digit].setText(text);
+                glyphs->digits[digit].setTextFormat(Qt::PlainText);
+                glyphs->digits[digit].prepare(QTransform(), glyphs->font);
+                glyphs->advances[digit] = metrics.horizontalAdvance(text);
+            }
+        }
+        return *glyphs;
+    }
+
     Editor *d_editor;
+    std::optional<DigitGlyphs> d_regularDigits;
+    std::optional<DigitGlyphs> d_boldDigits;
 };
 
 Editor::Editor(Document* doc, SpellChecker* spellChecker, QWidget* parent)
     : QTextEdit(parent)
     , d_spellChecker(spellChecker)
     , d_codeModel(doc->codeModel())
+    , d_profiler(nullptr)
+    , d_profilerOverlay(nullptr)
     , d_fontZoomFactor(1.0)
+    , d_gutterScrollPosition(0)
+    , d_gutterCursorBlockNumber(-1)
+    , d_gutterBlockCount(0)
+    , d_gutterDocumentHeight(0)
+    , d_gutterDirtyFrom(-1)
+    , d_gutterDirtyTo(-1)
     , d_pendingSuggestionsPosition(-1)
 {
     setAcceptRichText(false);
@@ -121,10 +198,29 @@ Editor::Editor(Document* doc, SpellChecker* spellChecker, QWidget* parent)
 
     connect(doc, &QTextDocument::blockCountChanged, this, &Editor::updateLineNumberGutterWidth);
     connect(layout, &EditorLayout::fullRelayoutDone, this, &Editor::updateLineNumberGutters);
-    connect(verticalScrollBar(), &QScrollBar::valueChanged, this, &Editor::updateLineNumberGutters);
-    connect(this, &QTextEdit::textChanged, this, &Editor::updateLineNumberGutters);
-    connect(this, &QTextEdit::cursorPositionChanged, this, &Editor::updateLineNumberGutters);
+    connect(verticalScrollBar(), &QScrollBar::valueChanged, this, &Editor::scrollLineNumberGutters);
+    connect(this, &QTextEdit::textChanged, this, &Editor::updateLineNumberGuttersForEdit);
+    connect(this, &QTextEdit::cursorPositionChanged, this, &Editor::updateLineNumberGuttersForCursor);
+    connect(doc, &QTextDocument::contentsChange, this, [this](int from, int charsRemoved, int charsAdded) {
+        Q_UNUSED(charsRemoved);
+
+        // Layout isn't updated yet, just remember what changed until textChanged
+        d_gutterDirtyFrom = (d_gutterDirtyFrom < 0) ? from : qMin(d_gutterDirtyFrom, from);
+        d_gutterDirtyTo = qMax(d_gutterDirtyTo, from + charsAdded);
+    });
     connect(this, &QTextEdit::cursorPositionChanged, this, &Editor::updateExtraSelections);
+    connect(layout, &EditorLayout::fullRelayoutDone, this, [this]() {
+        // Block heights may have changed everywhere, so the materialized
+        // range no longer says anything about what is around the viewport
+        d_diagnosticSelectionsBlockRange.reset();
+        updateDiagnosticSelections();
+    });
+    connect(verticalScrollBar(), &QScrollBar::valueChanged, this, &Editor::updateDiagnosticSelections);
+    connect(this, &QTextEdit::textChanged, this, [this]() {
+        // Diagnostic locations refer to the source as it was when last
+        // compiled; re-derive them on next update, like before the edit.
+        d_diagnosticSelectionsBlockRange.reset();
+    });
     connect(doc, &Document::contentReset, this, &Editor::resetNavigationData);
 
     connect(d_wheelTracker, &utils::WheelTracker::scrolled, this, [this](int units) {
@@ -236,13 +332,44 @@ void Editor::updateEditorTheme()
     d_theme = newTheme;
     setPalette(d_theme.adjustPalette(window()->palette()));
     forceRehighlighting();
+
+    d_diagnosticSelectionsBlockRange.reset();
     updateExtraSelections();
 }
 
 void Editor::setSourceDiagnostics(QList<typstdriver::Diagnostic> diagnostics)
 {
     d_sourceDiagnostics = diagnostics;
-    updateExtraSelections();
+    rebuildDiagnosticsIndex();
+    updateDiagnosticSelections();
+}
+
+void Editor::setProfilingEnabled(bool enabled)
+{
+    if (enabled == (d_profiler != nullptr)) {
+        return;
+    }
+
+    EditorLayout* layout = qobject_cast<EditorLayout*>(document()->documentLayout());
+
+    if (enabled) {
+        d_profiler = new EditorProfiler(this);
+        connect(document(), &QTextDocument::contentsChange, d_profiler, &EditorProfiler::markEdit);
+
+        d_profilerOverlay = new EditorProfilerOverlay(d_profiler, viewport(), this);
+        d_profilerOverlay->show();
+    }
+    else {
+        delete d_profilerOverlay;
+        delete d_profiler;
+        d_profilerOverlay = nullptr;
+        d_profiler = nullptr;
+    }
+
+    d_highlighter->setProfiler(d_profiler);
+    if (layout) {
+        layout->setProfiler(d_profiler);
+    }
 }
 
 QMenu* Editor::createInsertMenu()
@@ -1138,6 +1265,7 @@ void Editor::wheelEvent(QWheelEvent* event)
 void Editor::resizeEvent(QResizeEvent* event)
 {
     QTextEdit::resizeEvent(event);
+    updateDiagnosticSelections();
 
     QRect cr = contentsRect();
     int gutterWidth = lineNumberGutterWidth();
@@ -1161,6 +1289,15 @@ void Editor::resizeEvent(QResizeEvent* event)
     }
 }
 
+void Editor::paintEvent(QPaintEvent* event)
+{
+    QTextEdit::paintEvent(event);
+
+    if (d_profiler) {
+        d_profiler->endFrame();
+    }
+}
+
 QRect Editor::adjustedCursorRect(const QTextCursor& cursor)
 {
     EditorLayout* layout = qobject_cast<EditorLayout*>(document()->documentLayout());
@@ -1377,17 +1514,148 @@ void Editor::updateLineNumberGutterWidth()
 
 void Editor::updateLineNumberGutters()
 {
+    EditorProfiler::Scope profilerScope(d_profiler, EditorProfiler::Stage::LINE_NUMBER_GUTTERS);
+
     QRect cr = contentsRect();
     d_leftLineNumberGutter->update(0, cr.y(), d_leftLineNumberGutter->width(), cr.height());
     d_rightLineNumberGutter->update(0, cr.y(), d_rightLineNumberGutter->width(), cr.height());
 
     updateLineNumberGutterWidth();
 
-    int dy = verticalScrollBar()->sliderPosition();
-    if (dy >= 0) {
-        d_leftLineNumberGutter->scroll(0, dy);
-        d_rightLineNumberGutter->scroll(0, dy);
+    EditorLayout* layout = qobject_cast<EditorLayout*>(document()->documentLayout());
+
+    d_gutterScrollPosition = verticalScrollBar()->value();
+    d_gutterCursorBlockNumber = textCursor().blockNumber();
+    d_gutterBlockCount = document()->blockCount();
+    d_gutterDocumentHeight = layout ? layout->documentSize().height() : 0;
+    d_gutterDirtyFrom = -1;
+    d_gutterDirtyTo = -1;
+}
+
+void Editor::updateLineNumberGuttersForEdit()
+{
+    EditorProfiler::Scope profilerScope(d_profiler, EditorProfiler::Stage::LINE_NUMBER_GUTTERS);
+
+    EditorLayout* layout = qobject_cast<EditorLayout*>(document()->documentLayout());
+    if (!layout || d_gutterDirtyFrom < 0) {
+        return;
+    }
+
+    QTextBlock startBlock = document()->findBlock(d_gutterDirtyFrom);
+    QTextBlock endBlock = document()->findBlock(d_gutterDirtyTo);
+    if (!startBlock.isValid()) {
+        startBlock = document()->lastBlock();
+    }
+    if (!endBlock.isValid()) {
+        endBlock = document()->lastBlock();
+    }
+
+    d_gutterDirtyFrom = -1;
+    d_gutterDirtyTo = -1;
+
+    int blockCount = document()->blockCount();
+    qreal documentHeight = layout->documentSize().height();
+
+    // If blocks were added, removed or changed height, all the following
+    // line numbers moved. Otherwise only the edited blocks need repainting,
+    // for the sake of their background when showing line numbers on both sides.
+    qreal top = layout->blockDisplayRect(startBlock).top();
+    qreal bottom;
+    if (blockCount != d_gutterBlockCount || !qFuzzyCompare(documentHeight, d_gutterDocumentHeight)) {
+        bottom = qMax(documentHeight, d_gutterDocumentHeight);
+        updateLineNumberGutterWidth();
+    }
+    else {
+        bottom = layout->blockDisplayRect(endBlock).bottom();
+    }
+
+    d_gutterBlockCount = blockCount;
+    d_gutterDocumentHeight = documentHeight;
+
+    updateLineNumberGutterRange(top, bottom);
+}
+
+void Editor::updateLineNumberGuttersForCursor()
+{
+    EditorProfiler::Scope profilerScope(d_profiler, EditorProfiler::Stage::LINE_NUMBER_GUTTERS);
+
+    // Only the emphasis of the current line number can change
+    int blockNumber = textCursor().blockNumber();
+    if (blockNumber == d_gutterCursorBlockNumber) {
+        return;
+    }
+
+    updateLineNumberGutterBlock(d_gutterCursorBlockNumber);
+    updateLineNumberGutterBlock(blockNumber);
+    d_gutterCursorBlockNumber = blockNumber;
+}
+
+void Editor::scrollLineNumberGutters(int value)
+{
+    EditorProfiler::Scope profilerScope(d_profiler, EditorProfiler::Stage::LINE_NUMBER_GUTTERS);
+
+    int dy = d_gutterScrollPosition - value;
+    d_gutterScrollPosition = value;
+    if (dy == 0) {
+        return;
+    }
+
+    // Blit what is still visible, only the newly exposed strip is painted
+    QRect viewportGeometry = viewport()->geometry();
+    for (QWidget* gutter : { d_leftLineNumberGutter, d_rightLineNumberGutter }) {
+        if (!gutter->isVisible()) {
+            continue;
+        }
+
+        QRect scrollRect(0, viewportGeometry.top(), gutter->width(), viewportGeometry.height());
+        if (qAbs(dy) >= scrollRect.height()) {
+            gutter->update(scrollRect);
+        }
+        else {
+            gutter->scroll(0, dy, scrollRect);
+        }
+    }
+
+    // The number of a block that is partially scrolled out at the top isn't
+    // shown, while it might have been before the scroll.
+    EditorLayout* layout = qobject_cast<EditorLayout*>(document()->documentLayout());
+    if (layout) {
+        QTextBlock topBlock = layout->findContainingBlock(value);
+        if (topBlock.isValid()) {
+            updateLineNumberGutterBlock(topBlock.blockNumber());
+        }
+    }
+}
+
+void Editor::updateLineNumberGutterRange(qreal documentTop, qreal documentBottom)
+{
+    QRect viewportGeometry = viewport()->geometry();
+    int offset = viewportGeometry.top() - verticalScrollBar()->value();
+
+    // Pad by a pixel, the first block's number is painted slightly above it
+    int top = qMax(qFloor(documentTop) + offset - 1, viewportGeometry.top());
+    int bottom = qMin(qCeil(documentBottom) + offset + 1, viewportGeometry.bottom());
+    if (top > bottom) {
+        return;
+    }
+
+    for (QWidget* gutter : { d_leftLineNumberGutter, d_rightLineNumberGutter }) {
+        if (gutter->isVisible()) {
+            gutter->update(0, top, gutter->width(), bottom - top + 1);
+        }
+    }
+}
+
+void Editor::updateLineNumberGutterBlock(int blockNumber)
+{
+    EditorLayout* layout = qobject_cast<EditorLayout*>(document()->documentLayout());
+    QTextBlock block = document()->findBlockByNumber(blockNumber);
+    if (!layout || !block.isValid()) {
+        return;
     }
+
+    QRectF blockRect = layout->blockDisplayRect(block);
+    updateLineNumberGutterRange(blockRect.top(), blockRect.bottom());
 }
 
 QTextEdit::ExtraSelection Editor::makeBracketHighlight(int pos)
@@ -1402,12 +1670,14 @@ QTextEdit::ExtraSelection Editor::makeBracketHighlight(int pos)
 
 void Editor::updateExtraSelections()
 {
+    EditorProfiler::Scope profilerScope(d_profiler, EditorProfiler::Stage::EXTRA_SELECTIONS);
+
     QTextCursor cursor = textCursor();
     int currentPos = cursor.position();
 
     cursor.clearSelection();
 
-    QList<QTextEdit::ExtraSelection> extraSelections;
+    d_cursorSelections.clear();
 
     //
     // Current Line
@@ -1416,32 +1686,124 @@ void Editor::updateExtraSelections()
     currentLine.format.setBackground(d_theme.editorColor(EditorTheme::EditorColor::CURRENT_LINE));
     currentLine.format.setProperty(QTextFormat::FullWidthSelection, true);
     currentLine.cursor = cursor;
-    extraSelections.append(currentLine);
+    d_cursorSelections.append(currentLine);
 
     //
     // Bracket Matching
     //
     auto bracketPos = d_codeModel->findMatchingBracket(currentPos);
     if (bracketPos) {
-        extraSelections.append(makeBracketHighlight(currentPos));
-        extraSelections.append(makeBracketHighlight(bracketPos.value()));
+        d_cursorSelections.append(makeBracketHighlight(currentPos));
+        d_cursorSelections.append(makeBracketHighlight(bracketPos.value()));
     }
     else if (!cursor.atBlockStart()) {
         bracketPos = d_codeModel->findMatchingBracket(currentPos - 1);
         if (bracketPos) {
-            extraSelections.append(makeBracketHighlight(currentPos - 1));
-            extraSelections.append(makeBracketHighlight(bracketPos.value()));
+            d_cursorSelections.append(makeBracketHighlight(currentPos - 1));
+            d_cursorSelections.append(makeBracketHighlight(bracketPos.value()));
         }
     }
 
-    //
-    // Diagnostics
-    //
-    for (const typstdriver::Diagnostic& diagnostic : std::as_const(d_sourceDiagnostics)) {
+    ensureDiagnosticSelections();
+    applyExtraSelections();
+}
+
+void Editor::updateDiagnosticSelections()
+{
+    EditorProfiler::Scope profilerScope(d_profiler, EditorProfiler::Stage::EXTRA_SELECTIONS);
+
+    if (ensureDiagnosticSelections()) {
+        applyExtraSelections();
+    }
+}
+
+void Editor::applyExtraSelections()
+{
+    setExtraSelections(d_cursorSelections + d_diagnosticSelections);
+}
+
+std::tuple<int, int> Editor::visibleBlockRange() const
+{
+    int lastBlockNumber = document()->blockCount() - 1;
+
+    EditorLayout* layout = qobject_cast<EditorLayout*>(document()->documentLayout());
+    if (!layout) {
+        return std::make_tuple(0, lastBlockNumber);
+    }
+
+    int top = verticalScrollBar()->value();
+    int bottom = top + viewport()->height();
+
+    QTextBlock firstBlock = layout->findContainingBlock(top);
+    QTextBlock lastBlock = layout->findContainingBlock(bottom);
+
+    return std::make_tuple(
+        firstBlock.isValid() ? firstBlock.blockNumber() : 0,
+        lastBlock.isValid() ? lastBlock.blockNumber() : lastBlockNumber);
+}
+
+void Editor::rebuildDiagnosticsIndex()
+{
+    d_diagnosticsIndex.clear();
+
+    for (qsizetype i = 0; i < d_sourceDiagnostics.size(); i++) {
+        const typstdriver::Diagnostic& diagnostic = d_sourceDiagnostics[i];
         if (!diagnostic.startLocation() || !diagnostic.endLocation()) {
             continue;
         }
 
+        d_diagnosticsIndex.append(DiagnosticRange {
+            diagnostic.startLocation()->line,
+            diagnostic.endLocation()->line,
+            0,
+            i
+        });
+    }
+
+    std::stable_sort(d_diagnosticsIndex.begin(), d_diagnosticsIndex.end(), [](const DiagnosticRange& a, const DiagnosticRange& b) {
+        return a.startLine < b.startLine;
+    });
+
+    int maxEndLine = -1;
+    for (DiagnosticRange& range : d_diagnosticsIndex) {
+        maxEndLine = qMax(maxEndLine, range.endLine);
+        range.maxEndLine = maxEndLine;
+    }
+
+    d_diagnosticSelectionsBlockRange.reset();
+}
+
+bool Editor::ensureDiagnosticSelections()
+{
+    auto [firstVisible, lastVisible] = visibleBlockRange();
+
+    if (d_diagnosticSelectionsBlockRange) {
+        auto [firstMaterialized, lastMaterialized] = d_diagnosticSelectionsBlockRange.value();
+        if (firstVisible >= firstMaterialized && lastVisible <= lastMaterialized) {
+            return false;
+        }
+    }
+
+    // Materialize a page worth of blocks before and after the visible ones
+    // too, so that scrolling by small amounts doesn't need a rebuild.
+    int margin = lastVisible - firstVisible + 1;
+    int firstLine = qMax(0, firstVisible - margin);
+    int lastLine = lastVisible + margin;
+
+    d_diagnosticSelectionsBlockRange = std::make_tuple(firstLine, lastLine);
+    d_diagnosticSelections.clear();
+
+    auto it = std::partition_point(d_diagnosticsIndex.cbegin(), d_diagnosticsIndex.cend(), [firstLine](const DiagnosticRange& range) {
+        return range.maxEndLine < firstLine;
+    });
+
+    for (; it != d_diagnosticsIndex.cend() && it->startLine <= lastLine; ++it) {
+        if (it->endLine < firstLine) {
+            continue;
+        }
+
+        const typstdriver::Diagnostic& diagnostic = d_sourceDiagnostics[it->diagnosticIndex];
+
         QTextCursor start = cursorAt(diagnostic.startLocation()->line, diagnostic.startLocation()->column);
         QTextCursor end = cursorAt(diagnostic.endLocation()->line, diagnostic.endLocation()->column);
         if (start.isNull() || end.isNull()) {
@@ -1461,10 +1823,9 @@ void Editor::updateExtraSelections()
         selection.format.setForeground(noteColor);
         selection.format.setToolTip(diagnostic.message());
 
-        extraSelections.append(selection);
+        d_diagnosticSelections.append(selection);
     }
-
-    setExtraSelections(extraSelections);
+    return true;
 }
 
 void Editor::lineNumberGutterPaintEvent(QWidget* gutter, QPaintEvent* event)
@@ -1502,7 +1863,7 @@ void Editor::lineNumberGutterPaintEvent(QWidget* gutter, QPaintEvent* event)
         additionalMargin = doc->documentMargin() - 1 - verticalScrollBar()->sliderPosition();
     }
 
-    QRectF blockRect = layout->blockBoundingRect(block);
+    QRectF blockRect = layout->blockDisplayRect(block);
     qreal top = qMax(viewportGeometry.top() + additionalMargin, (qreal)viewportGeometry.top());
     qreal bottom = top + blockRect.intersected(documentVisibleRect).height();
 
@@ -1511,11 +1872,12 @@ void Editor::lineNumberGutterPaintEvent(QWidget* gutter, QPaintEvent* event)
     const qreal fontAscent = metrics.ascent();
 
     while (block.isValid() && top <= event->rect().bottom()) {
+        QTextLayout* blockLayout = layout->blockDisplayLayout(block);
         Qt::LayoutDirection blockDirection = block.layout()->textOption().textDirection();
-        QTextLine firstLine = block.layout()->lineAt(0);
+        QTextLine firstLine = blockLayout ? blockLayout->lineAt(0) : QTextLine();
 
         QBrush bgBrush;
-        int textFlags;
+        Qt::Alignment textFlags;
         int textOffset;
         if (gutter == d_leftLineNumberGutter) {
             bgBrush = (blockDirection == Qt::RightToLeft) ? secondaryBgBrush : gutterBgColor;
@@ -1535,13 +1897,6 @@ void Editor::lineNumberGutterPaintEvent(QWidget* gutter, QPaintEvent* event)
 
         // Draw the line number only if the block's top is visible
         if (blockRect.top() >= documentVisibleRect.top()) {
-            QString number = QString::number(block.blockNumber() + 1);
-
-            QFont f = gutter->font();
-            if (block.blockNumber() == blockNumberUnderCursor) {
-                f.setWeight(QFont::ExtraBold);
-            }
-            painter.setFont(f);
             painter.setPen(fgColor);
 
             QRectF textRect(textOffset, top, gutter->width(), lineHeight);
@@ -1549,11 +1904,13 @@ void Editor::lineNumberGutterPaintEvent(QWidget* gutter, QPaintEvent* event)
                 // Align baseline of line number with that of the actual line
                 textRect.translate(0, qMax(qRound(firstLine.ascent() - fontAscent), 0));
             }
-            painter.drawText(textRect, textFlags, number);
+
+            bool isCurrent = block.blockNumber() == blockNumberUnderCursor;
+            static_cast<LineNumberGutter*>(gutter)->drawLineNumber(painter, textRect, textFlags, block.blockNumber() + 1, isCurrent);
         }
 
         block = block.next();
-        blockRect = layout->blockBoundingRect(block);
+        blockRect = layout->blockDisplayRect(block);
         top = bottom;
         bottom = top + blockRect.intersected(documentVisibleRect).height();
     }
@@ -39,6 +39,8 @@ namespace katvan {
 class CodeModel;
 class CompletionManager;
 class Document;
+class EditorProfiler;
+class EditorProfilerOverlay;
 class Highlighter;
 class SpellChecker;
 
@@ -61,6 +63,7 @@ public:
     void applySettings(const EditorSettings& settings);
     void updateEditorTheme();
     void setSourceDiagnostics(QList<typstdriver::Diagnostic> diagnostics);
+    void setProfilingEnabled(bool enabled);
 
     QRect adjustedCursorRect(const QTextCursor& cursor);
 
@@ -99,6 +102,7 @@ protected:
     void mouseReleaseEvent(QMouseEvent* event) override;
     void wheelEvent(QWheelEvent* event) override;
     void resizeEvent(QResizeEvent* event) override;
+    void paintEvent(QPaintEvent* event) override;
 
 private:
     std::tuple<int, int> misspelledRangeAtCursor(QTextCursor cursor);
@@ -127,9 +131,15 @@ private:
     void applyEffectiveSettings();
 
     QTextEdit::ExtraSelection makeBracketHighlight(int pos);
+    std::tuple<int, int> visibleBlockRange() const;
+    void rebuildDiagnosticsIndex();
+    bool ensureDiagnosticSelections();
+    void applyExtraSelections();
 
     int lineNumberGutterWidth();
     void lineNumberGutterPaintEvent(QWidget* gutter, QPaintEvent* event);
+    void updateLineNumberGutterRange(qreal documentTop, qreal documentBottom);
+    void updateLineNumberGutterBlock(int blockNumber);
 
 private slots:
     void resetNavigationData();
@@ -140,7 +150,11 @@ private slots:
 
     void updateLineNumberGutterWidth();
     void updateLineNumberGutters();
+    void updateLineNumberGuttersForEdit();
+    void updateLineNumberGuttersForCursor();
+    void scrollLineNumberGutters(int value);
     void updateExtraSelections();
+    void updateDiagnosticSelections();
 
 signals:
     void goBackAvailable(bool available);
@@ -160,6 +174,8 @@ private:
     CodeModel* d_codeModel;
     CompletionManager* d_completionManager;
     utils::WheelTracker* d_wheelTracker;
+    EditorProfiler* d_profiler;
+    EditorProfilerOverlay* d_profilerOverlay;
 
     EditorSettings d_appSettings;
     EditorSettings d_fileMode;
@@ -167,7 +183,34 @@ private:
     EditorTheme d_theme;
     qreal d_fontZoomFactor;
 
+    // State of what was last painted in the line number gutters, to allow
+    // repainting only what changed
+    int d_gutterScrollPosition;
+    int d_gutterCursorBlockNumber;
+    int d_gutterBlockCount;
+    qreal d_gutterDocumentHeight;
+    int d_gutterDirtyFrom;
+    int d_gutterDirtyTo;
+
     QList<typstdriver::Diagnostic> d_sourceDiagnostics;
+
+    // Diagnostics with a location, sorted by start line. Each entry also
+    // has the maximal end line of all entries up to it, so the first entry
+    // that may intersect a given line range can be found by binary search.
+    struct DiagnosticRange {
+        int startLine;
+        int endLine;
+        int maxEndLine;
+        qsizetype diagnosticIndex;
+    };
+    QList<DiagnosticRange> d_diagnosticsIndex;
+
+    // Extra selections are kept in two parts, so that cursor movement only
+    // rebuilds the first, while only diagnostics near the visible part of
+    // the document are materialized into the second.
+    QList<QTextEdit::ExtraSelection> d_cursorSelections;
+    QList<QTextEdit::ExtraSelection> d_diagnosticSelections;
+    std::optional<std::tuple<int, int>> d_diagnosticSelectionsBlockRange;
     QPointer<QMenu> d_contextMenu;
 
     struct EditorLocation {
@@ -18,15 +18,21 @@
 #include "katvan_codemodel.h"
 #include "katvan_document.h"
 #include "katvan_editorlayout.h"
+#include "katvan_editorprofiler.h"
 #include "katvan_highlighter.h"
 #include "katvan_text_utils.h"
 
+#include <QCache>
+#include <QElapsedTimer>
 #include <QGuiApplication>
 #include <QPainter>
+#include <QPixmap>
 #include <QStyle>
 #include <QTextDocument>
 #include <QTimer>
+#include <QtMath>
 
+#include <algorithm>
 #include <memory>
 
 namespace katvan {
@@ -46,6 +52,12 @@ namespace katvan {
  * "display" text. Text and formats for the latter are derived from the former with
  * custom logic.
  *
+ * When a block has a display layout, only that one is shaped and laid out
+ * eagerly. The block's own (default) layout isn't used by us at all, but Qt's
+ * cursor navigation code does look at it; it is laid out lazily when Qt first
+ * asks for the block's bounding rectangle, which it always does before
+ * inspecting a block's layout.
+ *
  * While in theory this layout class can be used with any QTextEdit, by making
  * assumptions specific to Katvan we can cut all sorts of corners. These assumptions
  * are:
@@ -71,46 +83,160 @@ namespace katvan {
  *   test logic).
  */
 
-class LayoutBlockData : public QTextBlockUserData
+/**
+ * Mapping of character positions between a block's edit text and its display
+ * text. Every injected isolate control character shifts all following display
+ * positions, so the offset is a non-decreasing step function of the position
+ * in the edit text. Rather than storing the offset of every single character,
+ * store only the runs of positions sharing the same offset, allowing for a
+ * binary search in both directions.
+ */
+class DisplayOffsetMap
 {
 public:
-    static constexpr BlockDataKind DATA_KIND = BlockDataKind::LAYOUT;
+    DisplayOffsetMap() : d_length(0) {}
 
-    LayoutBlockData() : contentHash(qHash(QStringView())) {}
+    bool isEmpty() const { return d_runs.isEmpty(); }
 
-    std::unique_ptr<QTextLayout> displayLayout;
-    QList<ushort> displayOffsets;
-    size_t contentHash;
+    void clear()
+    {
+        d_runs.clear();
+        d_length = 0;
+    }
+
+    void assign(const QList<ushort>& offsets)
+    {
+        d_runs.clear();
+        d_length = static_cast<int>(offsets.size());
+
+        for (int i = 0; i < d_length; i++) {
+            if (d_runs.isEmpty() || d_runs.last().offset != offsets[i]) {
+                d_runs.append(Run { i, offsets[i] });
+            }
+        }
+    }
+
+    int toDisplay(int pos) const
+    {
+        if (d_runs.isEmpty()) {
+            return pos;
+        }
+
+        // Find the last run starting at or before pos. Positions past the end
+        // of the block share the offset of the block's last character.
+        auto it = std::upper_bound(d_runs.cbegin(), d_runs.cend(), pos, [](int p, const Run& run) {
+            return p < run.start;
+        });
+        if (it != d_runs.cbegin()) {
+            --it;
+        }
+        return pos + it->offset;
+    }
+
+    int fromDisplay(int pos) const
+    {
+        if (d_runs.isEmpty()) {
+            return pos;
+        }
+
+        // We want to find the first `i` such that `i + offset(i) >= pos`. The
+        // left hand side is strictly increasing, so first find the first run
+        // whose last character is displayed at or after pos.
+        qsizetype from = 0;
+        qsizetype to = d_runs.size();
+
+        while (from < to) {
+            qsizetype mid = from + (to - from) / 2;
+            if (runEnd(mid) - 1 + d_runs[mid].offset < pos) {
+                from = mid + 1;
+            }
+            else {
+                to = mid;
+            }
+        }
+
+        if (from == d_runs.size()) {
+            // If we are here, pos is after the the last character in block
+            return d_length;
+        }
+
+        const Run& run = d_runs[from];
+        return qMax(run.start, pos - run.offset);
+    }
+
+private:
+    struct Run {
+        int start;
+        int offset;
+    };
+
+    int runEnd(qsizetype index) const
+    {
+        return (index + 1 < d_runs.size()) ? d_runs[index + 1].start : d_length;
+    }
+
+    QList<Run> d_runs;
+    int d_length;
 };
 
-static int adjustPosToDisplay(const QList<ushort>& displayOffsets, int pos)
+/**
+ * A rendered image of an entire block, as painted by QTextLayout::draw with a
+ * given set of selection overlays. It is reused as long as the block wasn't
+ * laid out again and the selections over it and painting colors are the same,
+ * so that repaints caused by cursor blinking or scrolling are just a blit.
+ */
+struct BlockTile
 {
-    if (displayOffsets.isEmpty()) {
-        return pos;
-    }
-    return pos + displayOffsets[qMin(pos, displayOffsets.size() - 1)];
-}
+    QPixmap pixmap;
+    QList<QTextLayout::FormatRange> formats;
+    QColor penColor;
+    QColor baseColor;
+};
 
-static int adjustPosFromDisplay(const QList<ushort>& displayOffsets, int pos)
+// Tiles are keyed by the owning block's layout data, and their cost is in KiB
+class BlockTileCache : public QCache<const LayoutBlockData*, BlockTile>
 {
-    if (displayOffsets.isEmpty()) {
-        return pos;
-    }
+public:
+    BlockTileCache(qsizetype maxCost) : QCache(maxCost) {}
+};
+
+// Budget of memory used for cached block tiles, in KiB
+static constexpr qsizetype BLOCK_TILE_CACHE_BUDGET = 64 * 1024;
+
+// Blocks larger than this (in device pixels) are always painted directly
+static constexpr qsizetype MAX_BLOCK_TILE_PIXELS = 4 * 1024 * 1024;
+
+// Time after which a single paint stops rendering new block tiles
+static constexpr qint64 TILE_RENDER_FRAME_BUDGET_MS = 8;
+
+class LayoutBlockData : public QTextBlockUserData
+{
+public:
+    static constexpr BlockDataKind DATA_KIND = BlockDataKind::LAYOUT;
 
-    // We want to find the first `i` such that `i + displayOffsets[i] >= pos`.
-    for (qsizetype i = 0; i < displayOffsets.size(); i++) {
-        if (i + displayOffsets[i] >= pos) {
-            return i;
+    LayoutBlockData(std::weak_ptr<BlockTileCache> tileCache)
+        : contentHash(qHash(QStringView()))
+        , wrappingIndentWidth(0)
+        , tileCache(tileCache) {}
+
+    ~LayoutBlockData()
+    {
+        if (auto cache = tileCache.lock()) {
+            cache->remove(this);
         }
     }
 
-    // If we are here, pos is after the the last character in block
-    return displayOffsets.size();
-}
+    std::unique_ptr<QTextLayout> displayLayout;
+    DisplayOffsetMap displayOffsets;
+    size_t contentHash;
+    qreal wrappingIndentWidth;
+    std::weak_ptr<BlockTileCache> tileCache;
+};
 
 EditorLayout::EditorLayout(QTextDocument* document, CodeModel* codeModel)
     : QAbstractTextDocumentLayout(document)
     , d_codeModel(codeModel)
+    , d_tileCache(std::make_shared<BlockTileCache>(BLOCK_TILE_CACHE_BUDGET))
     , d_cursorWidth(1)
     , d_documentSize(0, 0)
 {
@@ -123,6 +249,11 @@ EditorLayout::EditorLayout(QTextDocument* document, CodeModel* codeModel)
     });
 }
 
+void EditorLayout::setProfiler(EditorProfiler* profiler)
+{
+    d_profiler = profiler;
+}
+
 QSizeF EditorLayout::documentSize() const
 {
     return d_documentSize;
@@ -149,15 +280,21 @@ QRectF EditorLayout::blockBoundingRect(const QTextBlock& block) const
     }
 
     auto* layoutData = BlockData::get<LayoutBlockData>(block);
-    if (layoutData == nullptr) {
-        return QRectF();
+    if (layoutData != nullptr && layoutData->displayLayout) {
+        ensureDefaultLayout(block, layoutData);
     }
 
-    QTextLayout* layout = layoutData->displayLayout
-        ? layoutData->displayLayout.get()
-        : block.layout();
+    return blockDisplayRect(block);
+}
+
+QRectF EditorLayout::blockDisplayRect(const QTextBlock& block) const
+{
+    if (!block.isValid() || !document()->isLayoutEnabled()) {
+        return QRectF();
+    }
 
-    if (layout->lineCount() == 0) {
+    QTextLayout* layout = blockDisplayLayout(block);
+    if (layout == nullptr || layout->lineCount() == 0) {
         return QRectF();
     }
 
@@ -166,6 +303,39 @@ QRectF EditorLayout::blockBoundingRect(const QTextBlock& block) const
     return rect;
 }
 
+QTextLayout* EditorLayout::blockDisplayLayout(const QTextBlock& block) const
+{
+    auto* layoutData = BlockData::get<LayoutBlockData>(block);
+    if (layoutData == nullptr) {
+        return nullptr;
+    }
+
+    return layoutData->displayLayout
+        ? layoutData->displayLayout.get()
+        : block.layout();
+}
+
+void EditorLayout::ensureDefaultLayout(const QTextBlock& block, const LayoutBlockData* layoutData) const
+{
+    QTextLayout* defaultLayout = block.layout();
+    QTextLayout* displayLayout = layoutData->displayLayout.get();
+
+    if (defaultLayout->lineCount() > 0 || displayLayout->lineCount() == 0) {
+        return;
+    }
+
+    doBlockLayout(
+        defaultLayout,
+        defaultLayout->textOption(),
+        layoutData->wrappingIndentWidth,
+        displayLayout->position().y());
+
+    if (displayLayout->boundingRect() != defaultLayout->boundingRect()) {
+        qWarning() << "Block" << block.blockNumber() << "display bounding rect differs from default one!"
+            << displayLayout->boundingRect() << "vs" << defaultLayout->boundingRect();
+    }
+}
+
 int EditorLayout::hitTest(const QPointF& point, Qt::HitTestAccuracy accuracy) const
 {
     if (accuracy == Qt::ExactHit && point.y() <= document()->documentMargin()) {
@@ -181,7 +351,11 @@ int EditorLayout::hitTest(const QPointF& point, Qt::HitTestAccuracy accuracy) co
     }
 
     LayoutBlockData* layoutData = BlockData::get<LayoutBlockData>(block);
-    QTextLayout* layout = (layoutData && layoutData->displayLayout)
+    if (layoutData == nullptr) {
+        return -1;
+    }
+
+    QTextLayout* layout = layoutData->displayLayout
         ? layoutData->displayLayout.get()
         : block.layout();
 
@@ -210,7 +384,7 @@ int EditorLayout::hitTest(const QPointF& point, Qt::HitTestAccuracy accuracy) co
                 }
                 pos -= layout->preeditAreaText().length();
             }
-            return block.position() + adjustPosFromDisplay(layoutData->displayOffsets, pos);
+            return block.position() + layoutData->displayOffsets.fromDisplay(pos);
         }
     }
     return -1;
@@ -230,6 +404,9 @@ void EditorLayout::draw(QPainter* painter, const QAbstractTextDocumentLayout::Pa
 
     QTextBlock block = findContainingBlock(clip.top());
 
+    QElapsedTimer paintTimer;
+    paintTimer.start();
+
     while (block.isValid()) {
         LayoutBlockData* layoutData = BlockData::get<LayoutBlockData>(block);
         QTextLayout* layout = layoutData->displayLayout
@@ -258,15 +435,15 @@ void EditorLayout::draw(QPainter* painter, const QAbstractTextDocumentLayout::Pa
                 int end = qMin(sel.cursor.selectionEnd() - blockStart, blockEnd);
 
                 QTextLayout::FormatRange fmt;
-                fmt.start = adjustPosToDisplay(layoutData->displayOffsets, start);
-                fmt.length = adjustPosToDisplay(layoutData->displayOffsets, end) - fmt.start;
+                fmt.start = layoutData->displayOffsets.toDisplay(start);
+                fmt.length = layoutData->displayOffsets.toDisplay(end) - fmt.start;
                 fmt.format = sel.format;
                 formats.append(fmt);
             }
             else if (!sel.cursor.hasSelection()
                         && sel.format.boolProperty(QTextFormat::FullWidthSelection)
                         && block.contains(sel.cursor.position())) {
-                int posInBlock = adjustPosToDisplay(layoutData->displayOffsets, sel.cursor.position() - blockStart);
+                int posInBlock = layoutData->displayOffsets.toDisplay(sel.cursor.position() - blockStart);
                 QTextLine line = layout->lineForTextPosition(posInBlock);
 
                 // Line may not be valid in layout if text was automatically
@@ -288,13 +465,17 @@ void EditorLayout::draw(QPainter* painter, const QAbstractTextDocumentLayout::Pa
             }
         }
 
-        layout->draw(painter, QPointF(), formats, clip);
+        // Rendering a tile costs a bit more than drawing the block directly,
+        // and only pays off on the next paint. If this paint is already slow,
+        // (e.g. scrolling fast to a new area) don't make it even slower.
+        bool allowTileRender = paintTimer.elapsed() < TILE_RENDER_FRAME_BUDGET_MS;
+        if (!drawBlockTile(painter, context, layoutData, layout, formats, maxX, allowTileRender)) {
+            layout->draw(painter, QPointF(), formats, clip);
+        }
 
         int cursorPosInBlock = -1;
         if (block.contains(context.cursorPosition)) {
-            cursorPosInBlock = adjustPosToDisplay(
-                layoutData->displayOffsets,
-                context.cursorPosition - block.position());
+            cursorPosInBlock = layoutData->displayOffsets.toDisplay(context.cursorPosition - block.position());
         }
         else if (context.cursorPosition < -1 && layout->preeditAreaPosition() >= 0) {
             cursorPosInBlock = layout->preeditAreaPosition() + qAbs(context.cursorPosition + 2);
@@ -309,6 +490,83 @@ void EditorLayout::draw(QPainter* painter, const QAbstractTextDocumentLayout::Pa
     }
 }
 
+bool EditorLayout::drawBlockTile(
+    QPainter* painter,
+    const QAbstractTextDocumentLayout::PaintContext& context,
+    const LayoutBlockData* layoutData,
+    QTextLayout* layout,
+    const QList<QTextLayout::FormatRange>& formats,
+    qreal maxX,
+    bool allowRender)
+{
+    // IME pre-edit text changes often and isn't worth caching
+    if (layout->preeditAreaPosition() >= 0) {
+        return false;
+    }
+
+    // Tiles span the full width of the text area, so that full width selections
+    // are included. Align them to whole pixels to avoid any blurry blits.
+    QRectF layoutRect = layout->boundingRect().translated(layout->position());
+    QRectF tileRect {
+        QPointF(0, qFloor(layoutRect.top())),
+        QPointF(qFloor(maxX), qCeil(layoutRect.bottom()))
+    };
+
+    qreal dpr = painter->device()->devicePixelRatio();
+    QSize pixelSize = (tileRect.size() * dpr).toSize();
+    if (pixelSize.isEmpty() || qsizetype(pixelSize.width()) * pixelSize.height() > MAX_BLOCK_TILE_PIXELS) {
+        return false;
+    }
+
+    QColor penColor = painter->pen().color();
+    QColor baseColor = context.palette.color(QPalette::Base);
+
+    BlockTile* tile = d_tileCache->object(layoutData);
+    bool tileValid = tile != nullptr
+        && tile->pixmap.size() == pixelSize
+        && qFuzzyCompare(tile->pixmap.devicePixelRatio(), dpr)
+        && tile->penColor == penColor
+        && tile->baseColor == baseColor
+        && tile->formats == formats;
+
+    if (tileValid) {
+        painter->drawPixmap(tileRect.topLeft(), tile->pixmap);
+        return true;
+    }
+    if (!allowRender) {
+        return false;
+    }
+
+    tile = new BlockTile();
+    tile->formats = formats;
+    tile->penColor = penColor;
+    tile->baseColor = baseColor;
+
+    // Paint on an opaque background, otherwise sub-pixel anti-aliasing of
+    // text is disabled and the result will look different.
+    tile->pixmap = QPixmap(pixelSize);
+    tile->pixmap.setDevicePixelRatio(dpr);
+    tile->pixmap.fill(baseColor);
+
+    QPainter tilePainter(&tile->pixmap);
+    tilePainter.setRenderHints(painter->renderHints());
+    tilePainter.setPen(painter->pen());
+    tilePainter.setFont(painter->font());
+    tilePainter.translate(-tileRect.topLeft());
+
+    layout->draw(&tilePainter, QPointF(), formats, tileRect);
+    tilePainter.end();
+
+    // If the tile doesn't fit the cache at all, inserting it deletes it. Keep
+    // a reference to the pixmap to still use it for this paint.
+    QPixmap pixmap = tile->pixmap;
+    qsizetype cost = qMax<qsizetype>(1, qsizetype(pixelSize.width()) * pixelSize.height() * pixmap.depth() / 8 / 1024);
+    d_tileCache->insert(layoutData, tile, cost);
+
+    painter->drawPixmap(tileRect.topLeft(), pixmap);
+    return true;
+}
+
 void EditorLayout::documentChanged(int position, int charsRemoved, int charsAdded)
 {
     if (!document()->isLayoutEnabled()) {
@@ -335,9 +593,11 @@ void EditorLayout::documentChanged(int position, int charsRemoved, int charsAdde
 
 void EditorLayout::doDocumentLayout(const QTextBlock& startBlock, const QTextBlock& endBlock)
 {
+    EditorProfiler::Scope profilerScope(d_profiler, EditorProfiler::Stage::DOCUMENT_LAYOUT);
+
     qreal y;
     if (startBlock.previous().isValid()) {
-        QRectF prevBoundingRect = blockBoundingRect(startBlock.previous());
+        QRectF prevBoundingRect = blockDisplayRect(startBlock.previous());
         y = prevBoundingRect.y() + prevBoundingRect.height();
     }
     else {
@@ -353,7 +613,7 @@ void EditorLayout::doDocumentLayout(const QTextBlock& startBlock, const QTextBlo
         updated = true;
         layoutBlock(block, y);
 
-        QRectF blockRect = blockBoundingRect(block);
+        QRectF blockRect = blockDisplayRect(block);
         y += blockRect.height();
     }
 
@@ -440,7 +700,7 @@ static void buildDisplayLayout(const QTextBlock& block, QString blockText, Layou
     // relative to the editable block content stored in the QTextDocument, so
     // we need to save an offset mapping.
 
-    auto& offsets = blockData->displayOffsets;
+    QList<ushort> offsets;
     offsets.resize(blockText.size());
     offsets.fill(0);
 
@@ -527,6 +787,8 @@ static void buildDisplayLayout(const QTextBlock& block, QString blockText, Layou
         formats.append(r);
     }
 
+    blockData->displayOffsets.assign(offsets);
+
     blockData->displayLayout = std::make_unique<QTextLayout>(blockText);
     blockData->displayLayout->setFormats(formats);
     blockData->displayLayout->setPreeditArea(preeditPos, defaultLayout->preeditAreaText());
@@ -534,11 +796,18 @@ static void buildDisplayLayout(const QTextBlock& block, QString blockText, Layou
 
 void EditorLayout::layoutBlock(QTextBlock& block, qreal topY)
 {
+    EditorProfiler::Scope profilerScope(d_profiler, EditorProfiler::Stage::BLOCK_LAYOUT);
+
     LayoutBlockData* blockData = BlockData::get<LayoutBlockData>(block);
     if (!blockData) {
-        blockData = new LayoutBlockData();
+        blockData = new LayoutBlockData(d_tileCache);
         BlockData::set<LayoutBlockData>(block, blockData);
     }
+    else {
+        // Block content, formats or geometry changed - any painted tile of
+        // it is stale.
+        d_tileCache->remove(blockData);
+    }
 
     QString blockText = block.text();
     Qt::LayoutDirection dir = getBlockDirection(block, blockText);
@@ -550,31 +819,41 @@ void EditorLayout::layoutBlock(QTextBlock& block, qreal topY)
     bool inContent = d_codeModel->canStartWithListItem(block);
     qreal wrappingIndentWidth = calculateIndentWidth(blockText, option, inContent);
 
+    blockData->wrappingIndentWidth = wrappingIndentWidth;
+
     QTextLayout* defaultLayout = block.layout();
-    doBlockLayout(defaultLayout, option, wrappingIndentWidth, topY);
-    block.setLineCount(defaultLayout->lineCount());
+    defaultLayout->setTextOption(option);
 
-    buildDisplayLayout(block, blockText, blockData);
+    {
+        EditorProfiler::Scope displayLayoutScope(d_profiler, EditorProfiler::Stage::DISPLAY_LAYOUT);
+        buildDisplayLayout(block, blockText, blockData);
+    }
 
     QTextLayout* displayLayout = blockData->displayLayout.get();
-    if (displayLayout != nullptr) {
-        displayLayout->setFont(document()->defaultFont());
-        displayLayout->setCursorMoveStyle(document()->defaultCursorMoveStyle());
+    if (displayLayout == nullptr) {
+        doBlockLayout(defaultLayout, option, wrappingIndentWidth, topY);
+        block.setLineCount(defaultLayout->lineCount());
+        return;
+    }
 
-        doBlockLayout(displayLayout, option, wrappingIndentWidth, topY);
+    displayLayout->setFont(document()->defaultFont());
+    displayLayout->setCursorMoveStyle(document()->defaultCursorMoveStyle());
 
-        if (displayLayout->boundingRect() != defaultLayout->boundingRect()) {
-            qWarning() << "Block" << block.blockNumber() << "display bounding rect differs from default one!"
-                << displayLayout->boundingRect() << "vs" << defaultLayout->boundingRect();
-        }
-    }
+    doBlockLayout(displayLayout, option, wrappingIndentWidth, topY);
+    block.setLineCount(displayLayout->lineCount());
+
+    // Shaping is the expensive part of laying out a block, don't do it twice.
+    // Drop any stale lines of the default layout; it will be redone lazily
+    // from blockBoundingRect if anything actually needs it.
+    defaultLayout->clearLayout();
+    defaultLayout->setPosition(displayLayout->position());
 }
 
 void EditorLayout::doBlockLayout(
     QTextLayout* layout,
     const QTextOption& option,
     qreal wrappingIndentWidth,
-    qreal topY)
+    qreal topY) const
 {
     qreal margin = document()->documentMargin();
     qreal availableWidth = document()->textWidth() - 2 * margin;
@@ -693,7 +972,7 @@ QTextBlock EditorLayout::findContainingBlock(qreal y) const
     while (from < to) {
         int mid = from + (to - from) / 2;
         QTextBlock block = document()->findBlockByNumber(mid);
-        QRectF blockRect = blockBoundingRect(block);
+        QRectF blockRect = blockDisplayRect(block);
 
         if (y >= blockRect.top() && y <= blockRect.bottom()) {
             return block;
@@ -721,7 +1000,7 @@ QPointF EditorLayout::cursorPositionPoint(int pos) const
         ? layoutData->displayLayout.get()
         : block.layout();
 
-    int posInBlock = adjustPosToDisplay(layoutData->displayOffsets, pos - block.position());
+    int posInBlock = layoutData->displayOffsets.toDisplay(pos - block.position());
     QTextLine line = layout->lineForTextPosition(posInBlock);
     if (!line.isValid()) {
         return QPointF();
@@ -746,7 +1025,7 @@ int EditorLayout::getLineEdgePosition(int pos, QTextLine::Edge edge) const
         ? layoutData->displayLayout.get()
         : block.layout();
 
-    int posInBlock = adjustPosToDisplay(layoutData->displayOffsets, pos - block.position());
+    int posInBlock = layoutData->displayOffsets.toDisplay(pos - block.position());
     QTextLine line = layout->lineForTextPosition(posInBlock);
     if (!line.isValid()) {
         return -1;
@@ -760,12 +1039,14 @@ int EditorLayout::getLineEdgePosition(int pos, QTextLine::Edge edge) const
         }
     }
 
-    int origLayoutPos = adjustPosFromDisplay(layoutData->displayOffsets, edgePos);
+    int origLayoutPos = layoutData->displayOffsets.fromDisplay(edgePos);
     return block.position() + origLayoutPos;
 }
 
 void EditorLayout::recalculateDocumentSize()
 {
+    EditorProfiler::Scope profilerScope(d_profiler, EditorProfiler::Stage::DOCUMENT_SIZE);
+
     // TODO: This way (recalculating from scratch after every change) ensures
     // correctness, but is somewhat inefficient. Try to find a way to maintain
     // the document's size incrementally. This is tricky because sometimes a
@@ -773,7 +1054,7 @@ void EditorLayout::recalculateDocumentSize()
     qreal height = 2 * document()->documentMargin();
 
     for (QTextBlock block = document()->begin(); block.isValid(); block = block.next()) {
-        height += blockBoundingRect(block).height();
+        height += blockDisplayRect(block).height();
     }
 
     QSizeF newDocumentSize(document()->textWidth(), height);
@@ -18,7 +18,11 @@
 #pragma once
 
 #include <QAbstractTextDocumentLayout>
+#include <QPointer>
 #include <QTextBlock>
+#include <QTextLayout>
+
+#include <memory>
 
 QT_BEGIN_NAMESPACE
 class QTimer;
@@ -26,7 +30,10 @@ QT_END_NAMESPACE
 
 namespace katvan {
 
+class BlockTileCache;
 class CodeModel;
+class EditorProfiler;
+class LayoutBlockData;
 
 class EditorLayout : public QAbstractTextDocumentLayout
 {
@@ -39,6 +46,8 @@ class EditorLayout : public QAbstractTextDocumentLayout
 public:
     EditorLayout(QTextDocument* document, CodeModel* codeModel);
 
+    void setProfiler(EditorProfiler* profiler);
+
     QSizeF documentSize() const override;
     int pageCount() const override;
     QRectF frameBoundingRect(QTextFrame* frame) const override;
@@ -46,6 +55,9 @@ public:
     int hitTest(const QPointF& point, Qt::HitTestAccuracy accuracy) const override;
     void draw(QPainter* painter, const QAbstractTextDocumentLayout::PaintContext& context) override;
 
+    QRectF blockDisplayRect(const QTextBlock& block) const;
+    QTextLayout* blockDisplayLayout(const QTextBlock& block) const;
+
     QTextBlock findContainingBlock(qreal y) const;
     QPointF cursorPositionPoint(int pos) const;
     int getLineEdgePosition(int pos, QTextLine::Edge edge) const;
@@ -59,13 +71,25 @@ protected:
 private:
     void doDocumentLayout(const QTextBlock& startBlock, const QTextBlock& endBlock);
     void layoutBlock(QTextBlock& block, qreal topY);
-    void doBlockLayout(QTextLayout* layout, const QTextOption& option, qreal wrappingIndentWidth, qreal topY);
+    void doBlockLayout(QTextLayout* layout, const QTextOption& option, qreal wrappingIndentWidth, qreal topY) const;
+    void ensureDefaultLayout(const QTextBlock& block, const LayoutBlockData* layoutData) const;
     Qt::LayoutDirection getBlockDirection(const QTextBlock& block, const QString& blockText);
     qreal calculateIndentWidth(const QString& text, const QTextOption& option, bool inContent);
     void recalculateDocumentSize();
 
+    bool drawBlockTile(
+        QPainter* painter,
+        const QAbstractTextDocumentLayout::PaintContext& context,
+        const LayoutBlockData* layoutData,
+        QTextLayout* layout,
+        const QList<QTextLayout::FormatRange>& formats,
+        qreal maxX,
+        bool allowRender);
+
     CodeModel* d_codeModel;
     QTimer* d_fullLayoutDebounceTimer;
+    std::shared_ptr<BlockTileCache> d_tileCache;
+    QPointer<EditorProfiler> d_profiler;
 
     int d_cursorWidth;
     QSizeF d_documentSize;
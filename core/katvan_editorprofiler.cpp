@@ -0,0 +1,196 @@
+/*
+ * This file is part of Katvan
+ * Copyright (c) 2024 - 2026 Igor Khanin
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "katvan_editorprofiler.h"
+
+#include <QEvent>
+#include <QFontDatabase>
+#include <QPainter>
+#include <QTimer>
+
+namespace katvan {
+
+static constexpr int OVERLAY_REFRESH_INTERVAL_MS = 100;
+static constexpr int OVERLAY_MARGIN = 8;
+static constexpr int OVERLAY_PADDING = 6;
+
+EditorProfiler::EditorProfiler(QObject* parent)
+    : QObject(parent)
+    , d_currentFrame{}
+    , d_lastFrame{}
+    , d_sinceEdit{}
+    , d_editInCurrentFrame(false)
+{
+}
+
+QString EditorProfiler::stageName(Stage stage)
+{
+    switch (stage) {
+        case Stage::HIGHLIGHT_BLOCK:     return QStringLiteral("highlightBlock");
+        case Stage::DOCUMENT_LAYOUT:     return QStringLiteral("doDocumentLayout");
+        case Stage::BLOCK_LAYOUT:        return QStringLiteral("  layoutBlock");
+        case Stage::DISPLAY_LAYOUT:      return QStringLiteral("    buildDisplayLayout");
+        case Stage::DOCUMENT_SIZE:       return QStringLiteral("  recalcDocumentSize");
+        case Stage::EXTRA_SELECTIONS:    return QStringLiteral("updateExtraSelections");
+        case Stage::LINE_NUMBER_GUTTERS: return QStringLiteral("updateLineNumberGutters");
+    }
+    return QString();
+}
+
+void EditorProfiler::record(Stage stage, qint64 nsecs)
+{
+    StageStats& stats = d_currentFrame[static_cast<size_t>(stage)];
+    stats.calls++;
+    stats.nsecs += nsecs;
+}
+
+void EditorProfiler::markEdit()
+{
+    d_editInCurrentFrame = true;
+}
+
+void EditorProfiler::endFrame()
+{
+    // Work caused by an edit is spread over several frames (deferred full
+    // relayouts, highlighting of following blocks, etc). Keep summing frames
+    // until a frame with a new edit starts the count over.
+    if (d_editInCurrentFrame) {
+        d_sinceEdit = d_currentFrame;
+    }
+    else {
+        for (size_t i = 0; i < STAGE_COUNT; i++) {
+            d_sinceEdit[i].calls += d_currentFrame[i].calls;
+            d_sinceEdit[i].nsecs += d_currentFrame[i].nsecs;
+        }
+    }
+
+    d_lastFrame = d_currentFrame;
+    d_currentFrame = Stats{};
+    d_editInCurrentFrame = false;
+
+    Q_EMIT frameFinished();
+}
+
+EditorProfilerOverlay::EditorProfilerOverlay(EditorProfiler* profiler, QWidget* anchor, QWidget* parent)
+    : QWidget(parent)
+    , d_profiler(profiler)
+    , d_anchor(anchor)
+{
+    // Being opaque is important - otherwise repainting the overlay would
+    // repaint the editor below it, finishing another frame and so on.
+    setAttribute(Qt::WA_OpaquePaintEvent);
+    setAttribute(Qt::WA_TransparentForMouseEvents);
+    setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+
+    d_refreshTimer = new QTimer(this);
+    d_refreshTimer->setSingleShot(true);
+    d_refreshTimer->setInterval(OVERLAY_REFRESH_INTERVAL_MS);
+    d_refreshTimer->callOnTimeout(this, [this]() {
+        updatePlacement();
+        update();
+    });
+
+    connect(d_profiler, &EditorProfiler::frameFinished, this, [this]() {
+        if (!d_refreshTimer->isActive()) {
+            d_refreshTimer->start();
+        }
+    });
+
+    d_anchor->installEventFilter(this);
+    updatePlacement();
+}
+
+QStringList EditorProfilerOverlay::formatLines() const
+{
+    QStringList result;
+    result.append(QStringLiteral("%1 %2 %3 %4 %5")
+        .arg(QString(), -26)
+        .arg(QStringLiteral("frame"), 7)
+        .arg(QStringLiteral("ms"), 8)
+        .arg(QStringLiteral("edit"), 7)
+        .arg(QStringLiteral("ms"), 8));
+
+    const EditorProfiler::Stats& frame = d_profiler->lastFrameStats();
+    const EditorProfiler::Stats& sinceEdit = d_profiler->sinceEditStats();
+
+    for (size_t i = 0; i < EditorProfiler::STAGE_COUNT; i++) {
+        QString name = EditorProfiler::stageName(static_cast<EditorProfiler::Stage>(i));
+        result.append(QStringLiteral("%1 %2 %3 %4 %5")
+            .arg(name, -26)
+            .arg(frame[i].calls, 7)
+            .arg(frame[i].nsecs / 1e6, 8, 'f', 2)
+            .arg(sinceEdit[i].calls, 7)
+            .arg(sinceEdit[i].nsecs / 1e6, 8, 'f', 2));
+    }
+    return result;
+}
+
+QSize EditorProfilerOverlay::sizeHint() const
+{
+    QFontMetrics metrics = fontMetrics();
+    const QStringList lines = formatLines();
+
+    int width = 0;
+    for (const QString& line : lines) {
+        width = qMax(width, metrics.horizontalAdvance(line));
+    }
+    return QSize(width + 2 * OVERLAY_PADDING, lines.size() * metrics.lineSpacing() + 2 * OVERLAY_PADDING);
+}
+
+bool EditorProfilerOverlay::eventFilter(QObject* obj, QEvent* event)
+{
+    if (obj == d_anchor && (event->type() == QEvent::Resize || event->type() == QEvent::Move)) {
+        updatePlacement();
+    }
+    return QWidget::eventFilter(obj, event);
+}
+
+void EditorProfilerOverlay::paintEvent(QPaintEvent* event)
+{
+    Q_UNUSED(event);
+
+    QPainter painter(this);
+    painter.fillRect(rect(), palette().color(QPalette::ToolTipBase));
+    painter.setPen(palette().color(QPalette::ToolTipText));
+
+    QFontMetrics metrics = fontMetrics();
+    int y = OVERLAY_PADDING + metrics.ascent();
+
+    const QStringList lines = formatLines();
+    for (const QString& line : lines) {
+        painter.drawText(OVERLAY_PADDING, y, line);
+        y += metrics.lineSpacing();
+    }
+}
+
+void EditorProfilerOverlay::updatePlacement()
+{
+    QSize size = sizeHint();
+    QRect anchorRect = d_anchor->geometry();
+    if (d_anchor->parentWidget() != parentWidget()) {
+        anchorRect.moveTopLeft(d_anchor->mapTo(parentWidget(), QPoint(0, 0)));
+    }
+
+    setGeometry(QRect(
+        QPoint(anchorRect.right() - size.width() - OVERLAY_MARGIN, anchorRect.top() + OVERLAY_MARGIN),
+        size));
+    raise();
+}
+
+}
+
+#include "moc_katvan_editorprofiler.cpp"
@@ -0,0 +1,136 @@
+/*
+ * This file is part of Katvan
+ * Copyright (c) 2024 - 2026 Igor Khanin
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QWidget>
+
+#include <array>
+
+QT_BEGIN_NAMESPACE
+class QTimer;
+QT_END_NAMESPACE
+
+namespace katvan {
+
+/**
+ * Collects timing of the editor's highlighting, layout and decoration stages,
+ * for diagnosing typing lag. Statistics are kept both for the last painted
+ * frame, and for everything done since the last frame that included a content
+ * edit.
+ */
+class EditorProfiler : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum class Stage {
+        HIGHLIGHT_BLOCK = 0,
+        DOCUMENT_LAYOUT,
+        BLOCK_LAYOUT,
+        DISPLAY_LAYOUT,
+        DOCUMENT_SIZE,
+        EXTRA_SELECTIONS,
+        LINE_NUMBER_GUTTERS,
+    };
+    static constexpr size_t STAGE_COUNT = 7;
+
+    struct StageStats {
+        qsizetype calls = 0;
+        qint64 nsecs = 0;
+    };
+    using Stats = std::array<StageStats, STAGE_COUNT>;
+
+    /**
+     * Times its own lifetime as a single invocation of the given stage. Does
+     * nothing if the profiler is null, so can be placed unconditionally.
+     */
+    class Scope
+    {
+    public:
+        Scope(EditorProfiler* profiler, Stage stage)
+            : d_profiler(profiler)
+            , d_stage(stage)
+        {
+            if (d_profiler) {
+                d_timer.start();
+            }
+        }
+
+        ~Scope()
+        {
+            if (d_profiler) {
+                d_profiler->record(d_stage, d_timer.nsecsElapsed());
+            }
+        }
+
+        Q_DISABLE_COPY_MOVE(Scope)
+
+    private:
+        EditorProfiler* d_profiler;
+        Stage d_stage;
+        QElapsedTimer d_timer;
+    };
+
+    EditorProfiler(QObject* parent = nullptr);
+
+    static QString stageName(Stage stage);
+
+    const Stats& lastFrameStats() const { return d_lastFrame; }
+    const Stats& sinceEditStats() const { return d_sinceEdit; }
+
+    void record(Stage stage, qint64 nsecs);
+
+public slots:
+    void markEdit();
+    void endFrame();
+
+signals:
+    void frameFinished();
+
+private:
+    Stats d_currentFrame;
+    Stats d_lastFrame;
+    Stats d_sinceEdit;
+    bool d_editInCurrentFrame;
+};
+
+class EditorProfilerOverlay : public QWidget
+{
+    Q_OBJECT
+
+public:
+    EditorProfilerOverlay(EditorProfiler* profiler, QWidget* anchor, QWidget* parent);
+
+    QSize sizeHint() const override;
+
+protected:
+    bool eventFilter(QObject* obj, QEvent* event) override;
+    void paintEvent(QPaintEvent* event) override;
+
+private:
+    QStringList formatLines() const;
+    void updatePlacement();
+
+    EditorProfiler* d_profiler;
+    QWidget* d_anchor;
+    QTimer* d_refreshTimer;
+};
+
+}
@@ -15,6 +15,7 @@
  * You should have received a copy of the GNU General Public License
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
+#include "katvan_editorprofiler.h"
 #include "katvan_editortheme.h"
 #include "katvan_highlighter.h"
 #include "katvan_spellchecker.h"
@@ -31,6 +32,11 @@ Highlighter::Highlighter(QTextDocument* document, SpellChecker* spellChecker, co
 {
 }
 
+void Highlighter::setProfiler(EditorProfiler* profiler)
+{
+    d_profiler = profiler;
+}
+
 static bool isShebangLine(QTextBlock block)
 {
     return block.blockNumber() == 0 && block.text().startsWith(QStringLiteral("#!"));
@@ -95,6 +101,8 @@ void Highlighter::reparseBlock(QTextBlock block)
 
 void Highlighter::highlightBlock(const QString& text)
 {
+    EditorProfiler::Scope profilerScope(d_profiler, EditorProfiler::Stage::HIGHLIGHT_BLOCK);
+
     StateSpansBlockData* blockData = nullptr;
 
     QList<QTextCharFormat> charFormats;
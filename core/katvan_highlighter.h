@@ -22,10 +22,12 @@
 #include "katvan_parsing.h"
 
 #include <QHash>
+#include <QPointer>
 #include <QSyntaxHighlighter>
 
 namespace katvan {
 
+class EditorProfiler;
 class EditorTheme;
 class SpellChecker;
 
@@ -82,6 +84,7 @@ public:
     Highlighter(QTextDocument* document, SpellChecker* spellChecker, const EditorTheme& theme);
 
     void reparseBlock(QTextBlock block);
+    void setProfiler(EditorProfiler* profiler);
 
 protected:
     void highlightBlock(const QString& text) override;
@@ -104,6 +107,7 @@ private:
 
     const EditorTheme& d_theme;
     SpellChecker* d_spellChecker;
+    QPointer<EditorProfiler> d_profiler;
 };
 
 }
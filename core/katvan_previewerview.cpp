@@ -37,25 +37,59 @@
 #include <QScreen>
 #include <QScrollBar>
 #include <QScroller>
+#include <QThreadPool>
 #include <QTimer>
 
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
 namespace katvan {
 
 static constexpr int PAGE_SPACING { 3 };
 static constexpr QMargins DOCUMENT_MARGINS { 6, 6, 6, 6 };
 
+// Pages that would take more pixels than this to render whole are instead
+// rendered in square tiles of the given size, and only where visible.
+static constexpr qreal TILED_RENDERING_MIN_PIXELS { 2048 * 2048 };
+static constexpr int TILE_SIZE { 512 };
+
+// Pages ahead of the scroll direction are prefetched as far as scrolling at
+// the current speed would reach in the lookahead time
+static constexpr int PREFETCH_INTERVAL_MS { 150 };
+static constexpr int PREFETCH_LOOKAHEAD_MS { 1000 };
+static constexpr int MAX_PREFETCH_PAGES { 6 };
+static constexpr qint64 SCROLL_VELOCITY_TIMEOUT_MS { 500 };
+
+// Cache costs are in KB of image data
+static int imageCost(const QImage& image)
+{
+    return static_cast<int>(qMax<qsizetype>(1, image.sizeInBytes() / 1024));
+}
+
+// Renders of a page kept for different zoom levels
+static constexpr qsizetype MAX_RENDER_LEVELS { 3 };
+
 PreviewerView::PreviewerView(TypstDriverWrapper* driver, QWidget* parent)
     : QAbstractScrollArea(parent)
     , d_zoomMode(ZoomMode::Custom)
     , d_zoomFactor(1.0)
     , d_currentPage(0)
     , d_invertColors(false)
+    , d_keepCompressedPages(true)
+    , d_vectorMode(false)
     , d_driver(driver)
     , d_scrollerGestureUngrabbed(false)
+    , d_firstVisiblePage(-1)
+    , d_lastVisiblePage(-1)
+    , d_scrollVelocity(0)
+    , d_compressionGeneration(0)
 {
     viewport()->setMouseTracking(true);
 
     connect(driver, &TypstDriverWrapper::pageRendered, this, &PreviewerView::pageRendered);
+    connect(driver, &TypstDriverWrapper::tileRendered, this, &PreviewerView::tileRendered);
+    connect(driver, &TypstDriverWrapper::pagePictureRendered, this, &PreviewerView::pagePictureRendered);
     connect(screen(), &QScreen::logicalDotsPerInchChanged, this, &PreviewerView::dpiChanged);
     connect(screen(), &QScreen::physicalDotsPerInchChanged, this, &PreviewerView::invalidateAllRenderCache);
 
@@ -63,10 +97,20 @@ PreviewerView::PreviewerView(TypstDriverWrapper* driver, QWidget* parent)
     horizontalScrollBar()->setSingleStep(20);
     dpiChanged();
 
-    d_invalidationTimer = new QTimer(this);
-    d_invalidationTimer->setSingleShot(true);
-    d_invalidationTimer->setInterval(100);
-    d_invalidationTimer->callOnTimeout(this, &PreviewerView::invalidateAllRenderCache);
+    d_zoomSettleTimer = new QTimer(this);
+    d_zoomSettleTimer->setSingleShot(true);
+    d_zoomSettleTimer->setInterval(100);
+    d_zoomSettleTimer->callOnTimeout(viewport(), qOverload<>(&QWidget::update));
+
+    d_prefetchTimer = new QTimer(this);
+    d_prefetchTimer->setSingleShot(true);
+    d_prefetchTimer->setInterval(PREFETCH_INTERVAL_MS);
+    d_prefetchTimer->callOnTimeout(this, &PreviewerView::prefetchPages);
+
+    d_compressionPool = new QThreadPool(this);
+    d_compressionPool->setMaxThreadCount(1);
+
+    setRenderCacheBudget(DEFAULT_RENDER_CACHE_BUDGET);
 
     d_wheelTracker = new utils::WheelTracker(this);
     connect(d_wheelTracker, &utils::WheelTracker::scrolled, this, &PreviewerView::zoomedByScrolling);
@@ -83,6 +127,13 @@ PreviewerView::PreviewerView(TypstDriverWrapper* driver, QWidget* parent)
     scrollerStateChanged();
 }
 
+PreviewerView::~PreviewerView()
+{
+    // Jobs deliver their results to this object, so must not outlive it
+    d_compressionPool->clear();
+    d_compressionPool->waitForDone();
+}
+
 QString PreviewerView::pageLabel(int page) const
 {
     if (d_pages.empty()) {
@@ -127,7 +178,11 @@ void PreviewerView::setPages(QList<typstdriver::PreviewPageData> pages)
 
     if (pages.isEmpty()) {
         // Reset before loading a new document - discard the entire cache.
+        d_compressionGeneration++;
         d_renderCache.clear();
+        d_tileCache.clear();
+        d_compressedCache.clear();
+        d_pictureCache.clear();
     }
     else if (hadPages) {
         // In case of new content in an already open preview - invalidate
@@ -144,6 +199,40 @@ void PreviewerView::setPages(QList<typstdriver::PreviewPageData> pages)
                 }
             }
         }
+
+        const QList<TileKey> tileKeys = d_tileCache.keys();
+        for (const TileKey& key : tileKeys) {
+            if (key.page >= pages.size()) {
+                d_tileCache.remove(key);
+            }
+            else {
+                CachedTile* tile = d_tileCache.object(key);
+                if (tile->fingerprint != pages[key.page].fingerprint) {
+                    tile->invalidated = true;
+                }
+            }
+        }
+
+        // Compressed copies are only worth keeping for unchanged pages
+        const QList<int> compressedKeys = d_compressedCache.keys();
+        for (int key : compressedKeys) {
+            if (key >= pages.size() || d_compressedCache.object(key)->fingerprint != pages[key].fingerprint) {
+                d_compressedCache.remove(key);
+            }
+        }
+
+        const QList<int> pictureKeys = d_pictureCache.keys();
+        for (int key : pictureKeys) {
+            if (key >= pages.size()) {
+                d_pictureCache.remove(key);
+            }
+            else {
+                CachedPicture* picture = d_pictureCache.object(key);
+                if (picture->fingerprint != pages[key].fingerprint) {
+                    picture->invalidated = true;
+                }
+            }
+        }
     }
 
     viewport()->update();
@@ -182,9 +271,46 @@ void PreviewerView::setInvertColors(bool value)
     }
     d_invertColors = value;
 
+    // Inversion is done by the render workers, right after rasterizing
+    d_driver->setInvertPreviewColors(value);
     invalidateAllRenderCache();
 }
 
+void PreviewerView::setRenderCacheBudget(int megabytes)
+{
+    // Most of the budget goes to whole page images. Tiles are only kept for
+    // what's around the viewport at high zoom levels, and pictures and
+    // compressed pages are a fraction of the size of the originals.
+    int budget = qMax(megabytes, MIN_RENDER_CACHE_BUDGET) * 1024;
+    d_renderCache.setMaxCost(budget / 2);
+    d_tileCache.setMaxCost(budget / 4);
+    d_pictureCache.setMaxCost(budget / 8);
+    d_compressedCache.setMaxCost(budget / 8);
+}
+
+void PreviewerView::setKeepCompressedPages(bool value)
+{
+    d_keepCompressedPages = value;
+    if (!value) {
+        d_compressionGeneration++;
+        d_compressedCache.clear();
+    }
+}
+
+void PreviewerView::setVectorMode(bool value)
+{
+    if (d_vectorMode == value) {
+        return;
+    }
+
+    d_vectorMode = value;
+    if (!value) {
+        d_pictureCache.clear();
+        d_driver->discardPictureFonts();
+    }
+    viewport()->update();
+}
+
 void PreviewerView::jumpTo(int page, QPointF pos)
 {
     if (page < 0 || page >= d_pageGeometries.size()) {
@@ -257,32 +383,70 @@ void PreviewerView::paintEvent(QPaintEvent* event)
     painter.fillRect(event->rect(), palette().brush(QPalette::Dark));
     painter.translate(-viewportRect.x(), -viewportRect.y());
 
-    bool paintedSomething = false;
+    int firstPaintedPage = -1;
+    int lastPaintedPage = -1;
+    QHash<int, QRect> visibleTileAreas;
 
     for (qsizetype i = 0; i < d_pageGeometries.size(); i++) {
         const QRect& pageGeometry = d_pageGeometries[i];
 
         if (!pageGeometry.intersects(viewportRect)) {
-            if (!paintedSomething) {
+            if (firstPaintedPage < 0) {
                 continue;
             }
             else {
                 break;
             }
         }
-        paintedSomething = true;
+        if (firstPaintedPage < 0) {
+            firstPaintedPage = static_cast<int>(i);
+        }
+        lastPaintedPage = static_cast<int>(i);
 
         painter.fillRect(pageGeometry, d_invertColors ? Qt::black : Qt::white);
 
+        if (d_vectorMode && paintPicture(painter, i)) {
+            continue;
+        }
+
+        qreal renderPointSize = this->renderPointSize(i);
+
+        // When rendering in tiles, a whole page image from before zooming in
+        // still serves as a placeholder for tiles not rendered yet
         CachedPage* renderedPage = d_renderCache.object(i);
+        // A page whose compressed copy is being restored is rendered only
+        // if the restored image turns out not to be sharp enough
+        bool restoring = renderedPage == nullptr && restoreCompressedPage(i);
         if (renderedPage != nullptr) {
-            painter.drawImage(pageGeometry, renderedPage->image);
+            painter.drawImage(pageGeometry, renderedPage->levelFor(renderPointSize).image);
+        }
+
+        if (isRenderedInTiles(i, renderPointSize)) {
+            QRect area = paintTiles(painter, i, pageGeometry.intersected(viewportRect), renderPointSize);
+            visibleTileAreas.insert(i, area);
         }
-        if (renderedPage == nullptr || renderedPage->invalidated) {
-            d_driver->renderPage(i, d_pointSize * effectiveZoom(i) * devicePixelRatio());
+        else if (!restoring && (renderedPage == nullptr || renderedPage->invalidated || needsSharperImage(renderedPage, renderPointSize))) {
+            // Ask for a quick low resolution pass first if we have nothing
+            // to show, or only something misleading or blurrier than it
+            bool withQuickPass = renderedPage == nullptr
+                || renderedPage->fingerprint != d_pages[i].fingerprint
+                || renderedPage->sharpestLevel().pointSize < renderPointSize * TypstDriverWrapper::QUICK_RENDER_SCALE;
+
+            d_driver->renderPage(i, renderPointSize, withQuickPass);
         }
     }
 
+    // Pages (or parts of them) scrolled out of view while the driver was
+    // busy need not be rendered anymore
+    d_driver->discardRenderRequestsOutside(firstPaintedPage, lastPaintedPage);
+    d_driver->discardTileRequestsOutside(visibleTileAreas);
+
+    d_firstVisiblePage = firstPaintedPage;
+    d_lastVisiblePage = lastPaintedPage;
+    if (!d_prefetchTimer->isActive()) {
+        d_prefetchTimer->start();
+    }
+
 #ifdef DEBUG_JUMP_POINT
     if (!d_lastJumpPoint.isNull()) {
         painter.fillRect(QRectF(d_lastJumpPoint.x() - 5, d_lastJumpPoint.y() - 5, 10, 10), Qt::blue);
@@ -371,58 +535,259 @@ void PreviewerView::scrollContentsBy(int dx, int dy)
 {
     QAbstractScrollArea::scrollContentsBy(dx, dy);
     updateCurrentPage();
+
+    // Track vertical scrolling speed in pixels per millisecond, positive
+    // when moving towards later pages
+    if (d_lastScrollTimer.isValid() && d_lastScrollTimer.elapsed() < SCROLL_VELOCITY_TIMEOUT_MS) {
+        qint64 elapsed = qMax<qint64>(1, d_lastScrollTimer.elapsed());
+        d_scrollVelocity = (d_scrollVelocity - dy / qreal(elapsed)) / 2;
+    }
+    else {
+        d_scrollVelocity = 0;
+    }
+    d_lastScrollTimer.start();
 }
 
-static void invertPageColors(QImage& image)
+const PreviewerView::CachedPage::Level* PreviewerView::CachedPage::findLevel(qreal pointSize) const
 {
-    static QHash<QRgb, QRgb> cache;
+    for (const Level& level : levels) {
+        if (level.pointSize == pointSize) {
+            return &level;
+        }
+    }
+    return nullptr;
+}
 
-    int height = image.height();
-    int width = image.width();
+const PreviewerView::CachedPage::Level& PreviewerView::CachedPage::sharpestLevel() const
+{
+    return *std::max_element(levels.begin(), levels.end(), [](const Level& a, const Level& b) {
+        return a.pointSize < b.pointSize;
+    });
+}
 
-    for (int i = 0; i < height; i++) {
-        QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(i));
-        for (int j = 0; j < width; j++) {
-            QRgb* pixel = &line[j];
-            QRgb result;
+const PreviewerView::CachedPage::Level& PreviewerView::CachedPage::levelFor(qreal pointSize) const
+{
+    const Level* level = findLevel(pointSize);
+    return level != nullptr ? *level : sharpestLevel();
+}
 
-            auto it = cache.find(*pixel);
-            if (it != cache.end()) {
-                result = it.value();
-            }
-            else {
-                QColor color = QColor::fromRgba(*pixel).toHsl();
-                color.setHsl(
-                    color.hue(),
-                    color.saturation(),
-                    255 - color.lightness(),
-                    color.alpha());
-
-                result = color.rgba();
-                cache[*pixel] = result;
+void PreviewerView::CachedPage::addLevel(qreal pointSize, QImage image)
+{
+    levels.removeIf([pointSize](const Level& level) { return level.pointSize == pointSize; });
+    levels.prepend(Level { pointSize, std::move(image) });
+    if (levels.size() > MAX_RENDER_LEVELS) {
+        levels.remove(MAX_RENDER_LEVELS, levels.size() - MAX_RENDER_LEVELS);
+    }
+}
+
+int PreviewerView::CachedPage::cost() const
+{
+    int result = 0;
+    for (const Level& level : levels) {
+        result += imageCost(level.image);
+    }
+    return result;
+}
+
+bool PreviewerView::needsSharperImage(const CachedPage* page, qreal renderPointSize) const
+{
+    // Right after a zoom change, scaling of an existing image is good enough
+    // until the zoom level settles. Same for quick pass images whose full
+    // resolution render was discarded.
+    return page->findLevel(renderPointSize) == nullptr && !d_zoomSettleTimer->isActive();
+}
+
+qreal PreviewerView::renderPointSize(int page) const
+{
+    return d_pointSize * effectiveZoom(page) * devicePixelRatio();
+}
+
+void PreviewerView::insertRenderedPage(int page, CachedPage* entry)
+{
+    // Several levels of a large page might not fit at all
+    while (entry->levels.size() > 1 && entry->cost() > d_renderCache.maxCost()) {
+        entry->levels.removeLast();
+    }
+
+    int cost = entry->cost();
+    d_renderCache.remove(page);
+
+    // Rather than QCache's least recently used order, make room by evicting
+    // the pages farthest from the current one - those are the least likely
+    // to be scrolled back to soon.
+    while (!d_renderCache.isEmpty() && d_renderCache.totalCost() + cost > d_renderCache.maxCost()) {
+        const QList<int> keys = d_renderCache.keys();
+        int farthest = *std::max_element(keys.begin(), keys.end(), [this](int a, int b) {
+            return qAbs(a - d_currentPage) < qAbs(b - d_currentPage);
+        });
+        evictRenderedPage(farthest);
+    }
+
+    d_renderCache.insert(page, entry, cost);
+}
+
+void PreviewerView::evictRenderedPage(int page)
+{
+    CachedPage* entry = d_renderCache.object(page);
+    if (d_keepCompressedPages && !entry->invalidated) {
+        // Rendered pages are mostly flat areas of background, so even the
+        // fastest compression level shrinks them a lot, and restoring them
+        // is much quicker than rendering again. Only the level best for
+        // the current zoom is kept. Compressing a large page still takes
+        // long enough to cause jank, so it is done on a worker thread.
+        const CachedPage::Level& level = entry->levelFor(renderPointSize(page));
+        QImage image = level.image;
+        quint64 fingerprint = entry->fingerprint;
+        qreal pointSize = level.pointSize;
+        quint64 generation = d_compressionGeneration;
+
+        d_compressionPool->start([this, page, generation, fingerprint, pointSize, image]() {
+            auto* compressed = new CompressedPage {
+                fingerprint,
+                pointSize,
+                image.devicePixelRatio(),
+                image.size(),
+                image.bytesPerLine(),
+                image.format(),
+                qCompress(image.constBits(), image.sizeInBytes(), 1)
+            };
+            QMetaObject::invokeMethod(this, [this, page, generation, compressed]() {
+                compressedPageReady(page, generation, compressed);
+            });
+        });
+    }
+    d_renderCache.remove(page);
+}
+
+void PreviewerView::compressedPageReady(int page, quint64 generation, CompressedPage* compressed)
+{
+    std::unique_ptr<CompressedPage> guard { compressed };
+    if (generation != d_compressionGeneration || page >= d_pages.size() || compressed->fingerprint != d_pages[page].fingerprint) {
+        return;
+    }
+
+    int cost = static_cast<int>(qMax<qsizetype>(1, compressed->data.size() / 1024));
+    d_compressedCache.insert(page, guard.release(), cost);
+}
+
+bool PreviewerView::restoreCompressedPage(int page)
+{
+    if (d_pendingRestores.contains(page)) {
+        return true;
+    }
+
+    CompressedPage* compressed = d_compressedCache.take(page);
+    if (compressed == nullptr) {
+        return false;
+    }
+
+    std::shared_ptr<CompressedPage> guard { compressed };
+    if (compressed->fingerprint != d_pages[page].fingerprint) {
+        return false;
+    }
+
+    d_pendingRestores.insert(page);
+    quint64 generation = d_compressionGeneration;
+
+    d_compressionPool->start([this, page, generation, guard]() {
+        QImage image;
+        QByteArray data = qUncompress(guard->data);
+        if (data.size() == guard->bytesPerLine * guard->size.height()) {
+            image = QImage { guard->size, guard->format };
+            qsizetype lineLength = qMin(guard->bytesPerLine, image.bytesPerLine());
+            for (int y = 0; y < image.height(); y++) {
+                memcpy(image.scanLine(y), data.constData() + y * guard->bytesPerLine, lineLength);
             }
-            *pixel = result;
+            image.setDevicePixelRatio(guard->devicePixelRatio);
         }
-    }
+
+        QMetaObject::invokeMethod(this, [this, page, generation, fingerprint = guard->fingerprint, pointSize = guard->pointSize, image]() {
+            compressedPageRestored(page, generation, fingerprint, pointSize, image);
+        });
+    });
+    return true;
 }
 
-void PreviewerView::pageRendered(int page, QImage image)
+void PreviewerView::compressedPageRestored(int page, quint64 generation, quint64 fingerprint, qreal pointSize, QImage image)
 {
-    if (page >= d_pages.size()) {
+    d_pendingRestores.remove(page);
+    if (generation != d_compressionGeneration || page >= d_pages.size() || fingerprint != d_pages[page].fingerprint) {
         return;
     }
 
-    if (d_invertColors) {
-        invertPageColors(image);
+    // Failing to restore just means the page will be rendered again
+    if (!image.isNull()) {
+        pageRendered(page, pointSize, image);
+    }
+    else {
+        viewport()->update();
     }
+}
 
+void PreviewerView::prepareRenderedImage(QImage& image) const
+{
     // When asking to render a page we give typst-render a higher DPI that
     // compensates for the gap between the page geometry in logical pixels
     // and and the scaled display pixels. Tell Qt that so it won't re-scale
     // the page image and introduce artifacts.
     image.setDevicePixelRatio(devicePixelRatio());
+}
+
+void PreviewerView::pageRendered(int page, qreal pointSize, QImage image)
+{
+    if (page >= d_pages.size()) {
+        return;
+    }
+
+    // A quick pass can finish after the full resolution render it was meant
+    // to precede, and must not replace it then
+    quint64 fingerprint = d_pages[page].fingerprint;
+    qreal targetPointSize = renderPointSize(page);
+
+    CachedPage* existing = d_renderCache.object(page);
+    bool existingValid = existing != nullptr && !existing->invalidated && existing->fingerprint == fingerprint;
+    if (existingValid && existing->findLevel(targetPointSize) != nullptr && pointSize != targetPointSize) {
+        return;
+    }
 
-    d_renderCache.insert(page, new CachedPage { d_pages[page].fingerprint, image });
+    prepareRenderedImage(image);
+
+    // Renders of the same content at other zoom levels are kept, so that
+    // going back to them (e.g. toggling between fit to width and fit to
+    // page) needs no rendering at all.
+    CachedPage* entry;
+    if (existingValid) {
+        entry = d_renderCache.take(page);
+        entry->addLevel(pointSize, image);
+    }
+    else {
+        entry = new CachedPage { fingerprint, pointSize, image };
+    }
+    insertRenderedPage(page, entry);
+    viewport()->update();
+}
+
+void PreviewerView::tileRendered(int page, qreal pointSize, QRect tile, QImage image)
+{
+    if (page >= d_pages.size()) {
+        return;
+    }
+
+    prepareRenderedImage(image);
+
+    TileKey key { page, tile.x(), tile.y() };
+    d_tileCache.insert(key, new CachedTile { d_pages[page].fingerprint, pointSize, image }, imageCost(image));
+    viewport()->update();
+}
+
+void PreviewerView::pagePictureRendered(int page, QPicture picture)
+{
+    if (page >= d_pages.size()) {
+        return;
+    }
+
+    int cost = qMax(1, picture.size() / 1024);
+    d_pictureCache.insert(page, new CachedPicture { d_pages[page].fingerprint, false, picture }, cost);
     viewport()->update();
 }
 
@@ -460,23 +825,105 @@ void PreviewerView::invalidateAllRenderCache()
     for (int page : pages) {
         d_renderCache.object(page)->invalidated = true;
     }
+
+    const QList<TileKey> tileKeys = d_tileCache.keys();
+    for (const TileKey& key : tileKeys) {
+        d_tileCache.object(key)->invalidated = true;
+    }
+
+    const QList<int> pictureKeys = d_pictureCache.keys();
+    for (int page : pictureKeys) {
+        d_pictureCache.object(page)->invalidated = true;
+    }
+
+    // Unlike the images above, these won't be shown until re-rendered, so
+    // there is no point in keeping them, or in ones still being compressed
+    d_compressionGeneration++;
+    d_compressedCache.clear();
     viewport()->update();
 }
 
-void PreviewerView::resetAllCalculations(bool invalidateRenderCache)
+void PreviewerView::prefetchPages()
+{
+    // Pictures are quick enough to create when pages come into view
+    if (d_vectorMode || d_firstVisiblePage < 0 || d_lastVisiblePage >= d_pages.size()) {
+        return;
+    }
+
+    qreal velocity = 0;
+    if (d_lastScrollTimer.isValid() && d_lastScrollTimer.elapsed() < SCROLL_VELOCITY_TIMEOUT_MS) {
+        velocity = d_scrollVelocity;
+    }
+
+    qreal pageHeight = qMax(1, d_pageGeometries[d_firstVisiblePage].height() + PAGE_SPACING);
+    int ahead = qBound(1, 1 + qRound(qAbs(velocity) * PREFETCH_LOOKAHEAD_MS / pageHeight), MAX_PREFETCH_PAGES);
+    int after = velocity >= 0 ? ahead : 1;
+    int before = velocity >= 0 ? 1 : ahead;
+
+    // Pages far from the viewport are the first to be evicted, so only
+    // what's visible limits how much can be prefetched
+    qint64 availableCost = d_renderCache.maxCost();
+    for (int i = d_firstVisiblePage; i <= d_lastVisiblePage; i++) {
+        CachedPage* cached = d_renderCache.object(i);
+        if (cached != nullptr) {
+            availableCost -= cached->cost();
+        }
+    }
+
+    // Nearest pages first
+    QList<int> candidates;
+    for (int distance = 1; distance <= qMax(after, before); distance++) {
+        if (distance <= after && d_lastVisiblePage + distance < d_pages.size()) {
+            candidates.append(d_lastVisiblePage + distance);
+        }
+        if (distance <= before && d_firstVisiblePage - distance >= 0) {
+            candidates.append(d_firstVisiblePage - distance);
+        }
+    }
+
+    QHash<int, qreal> pages;
+    for (int page : std::as_const(candidates)) {
+        qreal pointSize = renderPointSize(page);
+        if (isRenderedInTiles(page, pointSize)) {
+            continue;
+        }
+
+        CachedPage* cached = d_renderCache.object(page);
+        if (cached != nullptr && !cached->invalidated && cached->findLevel(pointSize) != nullptr) {
+            availableCost -= cached->cost();
+            continue;
+        }
+
+        QSizeF pixels = d_pages[page].sizeInPoints * pointSize;
+        qint64 cost = qint64(pixels.width()) * qint64(pixels.height()) * 4 / 1024;
+        if (cost > availableCost) {
+            break;
+        }
+        availableCost -= cost;
+
+        // A compressed copy is much quicker to restore than rendering again
+        if (restoreCompressedPage(page)) {
+            continue;
+        }
+        pages.insert(page, pointSize);
+    }
+
+    d_driver->prefetchPages(pages);
+}
+
+void PreviewerView::resetAllCalculations(bool geometryChanged)
 {
     updatePageGeometries();
     updateCurrentPage();
 
-    if (invalidateRenderCache) {
+    if (geometryChanged) {
         // If there wasn't a content change, but just a geometry change,
-        // keep the rendered pages but mark them for refresh. The idea
-        // is that until the pages are re-rendered we'll scale the
-        // existing bitmaps to the new size to avoid too much flicker,
-        // and then the sharper images will replace them. Do it via a
-        // debouncer to ensure that we don't re-render too much when e.g
-        // resizing the previewer pane.
-        d_invalidationTimer->start();
+        // keep the rendered pages. Until they are rendered for the new
+        // zoom level we'll scale the existing bitmaps to the new size to
+        // avoid too much flicker, and then the sharper images will be
+        // added to them. Do it via a debouncer to ensure that we don't
+        // re-render too much when e.g resizing the previewer pane.
+        d_zoomSettleTimer->start();
     }
 }
 
@@ -578,6 +1025,100 @@ void PreviewerView::updateCurrentPage()
     }
 }
 
+bool PreviewerView::isRenderedInTiles(int page, qreal renderPointSize) const
+{
+    QSizeF pixels = d_pages[page].sizeInPoints * renderPointSize;
+    return pixels.width() * pixels.height() > TILED_RENDERING_MIN_PIXELS;
+}
+
+QRect PreviewerView::paintTiles(QPainter& painter, int page, const QRect& visibleRect, qreal renderPointSize)
+{
+    const QRect& pageGeometry = d_pageGeometries[page];
+    QSize pageSizeInPixels = (d_pages[page].sizeInPoints * renderPointSize).toSize();
+    QRect pageRect { QPoint(0, 0), pageSizeInPixels };
+
+    // Tiles are laid out in the pixels of the whole page rendered at the
+    // requested point size, which are then mapped back to the page geometry.
+    qreal scaleX = pageGeometry.width() / qreal(pageSizeInPixels.width());
+    qreal scaleY = pageGeometry.height() / qreal(pageSizeInPixels.height());
+
+    QRectF visibleInPage = visibleRect.translated(-pageGeometry.topLeft()).toRectF();
+    QRect area = QRectF(
+        visibleInPage.x() / scaleX,
+        visibleInPage.y() / scaleY,
+        visibleInPage.width() / scaleX,
+        visibleInPage.height() / scaleY
+    ).toAlignedRect().intersected(pageRect);
+
+    if (area.isEmpty()) {
+        return area;
+    }
+
+    for (int y = area.top() / TILE_SIZE * TILE_SIZE; y <= area.bottom(); y += TILE_SIZE) {
+        for (int x = area.left() / TILE_SIZE * TILE_SIZE; x <= area.right(); x += TILE_SIZE) {
+            QRect tile = QRect(x, y, TILE_SIZE, TILE_SIZE).intersected(pageRect);
+
+            // Tiles rendered for another zoom level don't cover the same
+            // part of the page, so can't be used even as placeholders
+            CachedTile* cached = d_tileCache.object(TileKey { page, x, y });
+            bool usable = cached != nullptr && cached->pointSize == renderPointSize;
+
+            if (usable) {
+                QRectF target {
+                    pageGeometry.x() + tile.x() * scaleX,
+                    pageGeometry.y() + tile.y() * scaleY,
+                    tile.width() * scaleX,
+                    tile.height() * scaleY
+                };
+                painter.drawImage(target, cached->image);
+            }
+            if (!usable || cached->invalidated) {
+                d_driver->renderTile(page, renderPointSize, tile);
+            }
+        }
+    }
+    return area;
+}
+
+bool PreviewerView::paintPicture(QPainter& painter, int page)
+{
+    CachedPicture* cached = d_pictureCache.object(page);
+    bool current = cached != nullptr && !cached->invalidated && cached->fingerprint == d_pages[page].fingerprint;
+    if (!current) {
+        d_driver->renderPagePicture(page);
+    }
+
+    if (cached == nullptr) {
+        // Until the first picture arrives, a raster image of the page from
+        // before switching to vectors still serves as a placeholder
+        CachedPage* renderedPage = d_renderCache.object(page);
+        if (renderedPage != nullptr) {
+            painter.drawImage(d_pageGeometries[page], renderedPage->levelFor(renderPointSize(page)).image);
+        }
+        return true;
+    }
+    if (cached->picture.isNull()) {
+        // The page has content that can't be drawn as vectors, so it is
+        // rasterized as usual
+        return false;
+    }
+
+    // Pictures are in page points, and are scaled to any zoom level or
+    // device pixel ratio without rendering again
+    const QRect& pageGeometry = d_pageGeometries[page];
+    qreal scale = d_pointSize * effectiveZoom(page);
+
+    painter.save();
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    painter.setClipRect(pageGeometry);
+    painter.translate(pageGeometry.topLeft());
+    painter.scale(scale, scale);
+    painter.drawPicture(0, 0, cached->picture);
+    painter.restore();
+    return true;
+}
+
 }
 
 #include "moc_katvan_previewerview.cpp"
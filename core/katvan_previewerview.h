@@ -20,15 +20,22 @@
 #include "typstdriver_engine.h"
 
 #include <QAbstractScrollArea>
+#include <QByteArray>
 #include <QCache>
+#include <QElapsedTimer>
+#include <QHash>
 #include <QImage>
 #include <QList>
+#include <QSet>
+#include <QPicture>
 
 QT_BEGIN_NAMESPACE
 class QKeyEvent;
 class QMouseEvent;
+class QPainter;
 class QPaintEvent;
 class QResizeEvent;
+class QThreadPool;
 class QTimer;
 QT_END_NAMESPACE
 
@@ -49,7 +56,12 @@ public:
     };
     Q_ENUM(ZoomMode);
 
+    // Memory for rendered page images, tiles, pictures and compressed copies, in MB
+    static constexpr int DEFAULT_RENDER_CACHE_BUDGET = 256;
+    static constexpr int MIN_RENDER_CACHE_BUDGET = 64;
+
     PreviewerView(TypstDriverWrapper* driver, QWidget* parent = nullptr);
+    ~PreviewerView();
 
     int currentPage() const { return d_currentPage; }
     int pageCount() const { return d_pages.size(); }
@@ -72,6 +84,9 @@ public slots:
     void setZoomMode(katvan::PreviewerView::ZoomMode mode);
     void setCustomZoomFactor(qreal zoom);
     void setInvertColors(bool value);
+    void setRenderCacheBudget(int megabytes);
+    void setKeepCompressedPages(bool value);
+    void setVectorMode(bool value);
     void jumpTo(int page, QPointF pos);
     void goToPage(int page);
 
@@ -85,45 +100,131 @@ protected:
     void scrollContentsBy(int dx, int dy) override;
 
 private slots:
-    void pageRendered(int page, QImage image);
+    void pageRendered(int page, qreal pointSize, QImage image);
+    void tileRendered(int page, qreal pointSize, QRect tile, QImage image);
+    void pagePictureRendered(int page, QPicture picture);
     void dpiChanged();
     void scrollerStateChanged();
     void invalidateAllRenderCache();
+    void prefetchPages();
 
 private:
-    void resetAllCalculations(bool invalidateRenderCache = true);
+    struct CachedPage;
+    struct CompressedPage;
+
+    void resetAllCalculations(bool geometryChanged = true);
     void calculatePageGeometries();
     void updateScrollbars(QSize documentSize, bool forceVerticalScrollBar);
     void updatePageGeometries();
     void updateCurrentPage();
+    qreal renderPointSize(int page) const;
+    void insertRenderedPage(int page, CachedPage* entry);
+    void evictRenderedPage(int page);
+    bool restoreCompressedPage(int page);
+    void compressedPageReady(int page, quint64 generation, CompressedPage* compressed);
+    void compressedPageRestored(int page, quint64 generation, quint64 fingerprint, qreal pointSize, QImage image);
+    bool needsSharperImage(const CachedPage* page, qreal renderPointSize) const;
+    void prepareRenderedImage(QImage& image) const;
+    bool isRenderedInTiles(int page, qreal renderPointSize) const;
+    QRect paintTiles(QPainter& painter, int page, const QRect& visibleRect, qreal renderPointSize);
+    bool paintPicture(QPainter& painter, int page);
 
     ZoomMode d_zoomMode;
     qreal d_zoomFactor;
     qreal d_pointSize;
     int d_currentPage;
     bool d_invertColors;
+    bool d_keepCompressedPages;
+    bool d_vectorMode;
 
     TypstDriverWrapper* d_driver;
-    QTimer* d_invalidationTimer;
+    QTimer* d_zoomSettleTimer;
+    QTimer* d_prefetchTimer;
     utils::WheelTracker* d_wheelTracker;
 
     QList<typstdriver::PreviewPageData> d_pages;
     QList<QRect> d_pageGeometries;
     QSize d_documentSize;
     bool d_scrollerGestureUngrabbed;
+    int d_firstVisiblePage;
+    int d_lastVisiblePage;
+    qreal d_scrollVelocity;
+    QElapsedTimer d_lastScrollTimer;
     QPointF d_lastJumpPoint;
 
     struct CachedPage {
-        CachedPage(quint64 fingerprint, QImage image)
+        struct Level {
+            qreal pointSize;
+            QImage image;
+        };
+
+        CachedPage(quint64 fingerprint, qreal pointSize, QImage image)
             : fingerprint(fingerprint)
             , invalidated(false)
+            , levels({ Level { pointSize, std::move(image) } }) {}
+
+        const Level* findLevel(qreal pointSize) const;
+        const Level& sharpestLevel() const;
+        const Level& levelFor(qreal pointSize) const;
+        void addLevel(qreal pointSize, QImage image);
+        int cost() const;
+
+        quint64 fingerprint;
+        bool invalidated;
+        QList<Level> levels; // Renders of the same content at several zoom levels, most recent first
+    };
+    QCache<int, CachedPage> d_renderCache;
+
+    struct TileKey {
+        int page;
+        int x;
+        int y;
+
+        bool operator==(const TileKey&) const = default;
+
+        friend size_t qHash(const TileKey& key, size_t seed = 0) noexcept
+        {
+            return qHashMulti(seed, key.page, key.x, key.y);
+        }
+    };
+
+    struct CachedTile {
+        CachedTile(quint64 fingerprint, qreal pointSize, QImage image)
+            : fingerprint(fingerprint)
+            , pointSize(pointSize)
+            , invalidated(false)
             , image(std::move(image)) {}
 
         quint64 fingerprint;
+        qreal pointSize;
         bool invalidated;
         QImage image;
     };
-    QCache<int, CachedPage> d_renderCache;
+    QCache<TileKey, CachedTile> d_tileCache;
+
+    struct CompressedPage {
+        quint64 fingerprint;
+        qreal pointSize;
+        qreal devicePixelRatio;
+        QSize size;
+        qsizetype bytesPerLine;
+        QImage::Format format;
+        QByteArray data;
+    };
+    QCache<int, CompressedPage> d_compressedCache;
+
+    // Compressing and restoring page images is done off the GUI thread. The
+    // generation is bumped whenever results of jobs in flight became stale.
+    QThreadPool* d_compressionPool;
+    quint64 d_compressionGeneration;
+    QSet<int> d_pendingRestores;
+
+    struct CachedPicture {
+        quint64 fingerprint;
+        bool invalidated;
+        QPicture picture; // Null if the page can't be drawn as vectors
+    };
+    QCache<int, CachedPicture> d_pictureCache;
 };
 
 }
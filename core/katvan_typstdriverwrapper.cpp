@@ -21,19 +21,36 @@
 #include "typstdriver_compilersettings.h"
 #include "typstdriver_packagemanager.h"
 
+#include <QDateTime>
 #include <QDebug>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QThread>
+#include <QTimer>
 
+#include <algorithm>
 #include <optional>
 
 namespace katvan {
 
+static constexpr int DEFAULT_PREVIEW_DELAY_MS = 500;
+static constexpr int MIN_ADAPTIVE_PREVIEW_DELAY_MS = 50;
+static constexpr int MAX_ADAPTIVE_PREVIEW_DELAY_MS = 2000;
+static constexpr qsizetype COMPILE_DURATION_WINDOW = 8;
+
+using Priority = DriverRequestQueue::Priority;
+
 TypstDriverWrapper::TypstDriverWrapper(QObject* parent)
     : QObject(parent)
     , d_engine(nullptr)
+    , d_requestQueue(std::make_shared<DriverRequestQueue>())
     , d_status(Status::INITIALIZING)
+    , d_followUpCompilePending(false)
+    , d_previewDelay(DEFAULT_PREVIEW_DELAY_MS)
     , d_settings(std::make_shared<typstdriver::TypstCompilerSettings>())
     , d_lastMetadataFingerprint(0)
+    , d_invertPreviewColors(false)
 {
     d_thread = new QThread(this);
     d_thread->setObjectName("TypstDriverThread");
@@ -75,21 +92,59 @@ void TypstDriverWrapper::setCompilerSettings(const typstdriver::TypstCompilerSet
     d_packageManager->applySettings(d_settings);
 
     if (d_status != Status::INITIALIZING) {
-        QMetaObject::invokeMethod(d_engine, &typstdriver::Engine::applySettings, *d_settings);
+        enqueue(Priority::STATE, [settings = *d_settings](typstdriver::Engine* engine) { engine->applySettings(settings); });
+    }
+
+    updatePreviewDelay();
+}
+
+void TypstDriverWrapper::setStatisticsLogFile(const QString& filePath)
+{
+    d_statisticsLogFile = filePath;
+}
+
+void TypstDriverWrapper::setInvertPreviewColors(bool invert)
+{
+    if (invert == d_invertPreviewColors) {
+        return;
     }
+    d_invertPreviewColors = invert;
+
+    // Results of earlier requests are dropped on arrival, so they must not
+    // block requesting the same pages again
+    d_pendingPagesToRender.clear();
+    d_pendingPrefetches.clear();
+    d_pendingTilesToRender.clear();
+    d_pendingPicturesToRender.clear();
 }
 
 void TypstDriverWrapper::resetInputFile(const QString& sourceFileName)
 {
     d_status = Status::INITIALIZING;
+    d_followUpCompilePending = false;
     Q_EMIT compilationStatusChanged();
 
+    // Compile times of one document say nothing about another
+    d_recentCompileDurations.clear();
+    updatePreviewDelay();
+
     d_diagnosticsModel->setInputFileName(sourceFileName);
 
     if (d_engine != nullptr) {
         d_engine->deleteLater();
     }
 
+    // Requests still queued were meant for the previous engine. Each engine
+    // gets its own queue, so ones its delivery events could pick up are
+    // never run against the new engine before it is initialized.
+    d_requestQueue->clear();
+    d_requestQueue = std::make_shared<DriverRequestQueue>();
+    d_pendingPagesToRender.clear();
+    d_pendingPrefetches.clear();
+    d_pendingTilesToRender.clear();
+    d_pendingPicturesToRender.clear();
+    d_editBatch.clear();
+
     d_engine = new typstdriver::Engine(sourceFileName, d_compilerLogger, d_packageManager);
     d_engine->moveToThread(d_thread);
 
@@ -97,7 +152,7 @@ void TypstDriverWrapper::resetInputFile(const QString& sourceFileName)
         d_status = Status::INITIALIZED;
         Q_EMIT compilationStatusChanged();
 
-        QMetaObject::invokeMethod(d_engine, &typstdriver::Engine::applySettings, *d_settings);
+        enqueue(Priority::STATE, [settings = *d_settings](typstdriver::Engine* engine) { engine->applySettings(settings); });
 
         bool hasPending = false;
         if (d_pendingSource) {
@@ -106,9 +161,25 @@ void TypstDriverWrapper::resetInputFile(const QString& sourceFileName)
             d_pendingSource = std::nullopt;
             hasPending = true;
         }
+        for (auto it = d_pendingFileSources.cbegin(); it != d_pendingFileSources.cend(); ++it) {
+            if (it.value()) {
+                setFileSource(it.key(), it.value().value());
+            }
+            else {
+                closeFile(it.key());
+            }
+            hasPending = true;
+        }
+        d_pendingFileSources.clear();
+
         if (!d_pendingEdits.isEmpty()) {
             for (const auto& edit : std::as_const(d_pendingEdits)) {
-                applyContentEdit(edit.from, edit.to, edit.text);
+                if (edit.filePath.isEmpty()) {
+                    applyContentEdit(edit.from, edit.to, edit.text);
+                }
+                else {
+                    applyFileContentEdit(edit.filePath, edit.from, edit.to, edit.text);
+                }
             }
 
             d_pendingEdits.clear();
@@ -121,8 +192,11 @@ void TypstDriverWrapper::resetInputFile(const QString& sourceFileName)
     };
 
     connect(d_engine, &typstdriver::Engine::compilationFinished, this, &TypstDriverWrapper::compilationFinished);
-    connect(d_engine, &typstdriver::Engine::previewReady, this, &TypstDriverWrapper::previewReady);
+    connect(d_engine, &typstdriver::Engine::compilationStatisticsReady, this, &TypstDriverWrapper::compilationStatisticsReady);
+    connect(d_engine, &typstdriver::Engine::previewReady, this, &TypstDriverWrapper::previewReadyInternal);
     connect(d_engine, &typstdriver::Engine::pageRendered, this, &TypstDriverWrapper::pageRenderComplete);
+    connect(d_engine, &typstdriver::Engine::tileRendered, this, &TypstDriverWrapper::tileRenderComplete);
+    connect(d_engine, &typstdriver::Engine::pagePictureRendered, this, &TypstDriverWrapper::pagePictureComplete);
     connect(d_engine, &typstdriver::Engine::exportFinished, this, &TypstDriverWrapper::exportFinished);
     connect(d_engine, &typstdriver::Engine::jumpToPreview, this, &TypstDriverWrapper::jumpToPreview);
     connect(d_engine, &typstdriver::Engine::jumpToEditor, this, &TypstDriverWrapper::jumpToEditor);
@@ -139,49 +213,335 @@ void TypstDriverWrapper::resetInputFile(const QString& sourceFileName)
 void TypstDriverWrapper::setSource(const QString& text)
 {
     if (d_status == Status::INITIALIZING) {
-        d_pendingEdits.clear();
+        d_pendingEdits.removeIf([](const PendingEdit& edit) { return edit.filePath.isEmpty(); });
         d_pendingSource = text;
         return;
     }
 
-    QMetaObject::invokeMethod(d_engine, &typstdriver::Engine::setSource, text);
+    enqueue(Priority::STATE, [text](typstdriver::Engine* engine) { engine->setSource(text); });
 }
 
 void TypstDriverWrapper::applyContentEdit(int from, int to, QString text)
 {
     if (d_status == Status::INITIALIZING) {
-        d_pendingEdits.append(PendingEdit { from, to, text });
+        d_pendingEdits.append(PendingEdit { from, to, text, QString() });
+        return;
+    }
+
+    appendToEditBatch(PendingEdit { from, to, text, QString() });
+}
+
+void TypstDriverWrapper::setFileSource(const QString& filePath, const QString& text)
+{
+    if (d_status == Status::INITIALIZING) {
+        d_pendingEdits.removeIf([&filePath](const PendingEdit& edit) { return edit.filePath == filePath; });
+        d_pendingFileSources.insert(filePath, text);
         return;
     }
 
-    QMetaObject::invokeMethod(d_engine, &typstdriver::Engine::applyContentEdit, from, to, text);
+    enqueue(Priority::STATE, [filePath, text](typstdriver::Engine* engine) { engine->setFileSource(filePath, text); });
+}
+
+void TypstDriverWrapper::applyFileContentEdit(const QString& filePath, int from, int to, QString text)
+{
+    if (d_status == Status::INITIALIZING) {
+        d_pendingEdits.append(PendingEdit { from, to, text, filePath });
+        return;
+    }
+
+    appendToEditBatch(PendingEdit { from, to, text, filePath });
+}
+
+void TypstDriverWrapper::appendToEditBatch(const PendingEdit& edit)
+{
+    d_editStatistics.received++;
+
+    // Large pastes and replace-all operations emit a separate edit for each
+    // changed block. Collect everything edited in the same event loop
+    // iteration, and hand it to the engine in one go.
+    if (d_editBatch.isEmpty()) {
+        QTimer::singleShot(0, this, &TypstDriverWrapper::flushEditBatch);
+    }
+    if (d_editBatch.append(edit)) {
+        d_editStatistics.coalesced++;
+    }
+}
+
+void TypstDriverWrapper::flushEditBatch()
+{
+    if (d_editBatch.isEmpty()) {
+        return;
+    }
+
+    QList<PendingEdit> batch = d_editBatch.take();
+
+    qsizetype start = 0;
+    while (start < batch.size()) {
+        QString filePath = batch[start].filePath;
+
+        QList<typstdriver::SourceEdit> edits;
+        qsizetype end = start;
+        while (end < batch.size() && batch[end].filePath == filePath) {
+            edits.append(typstdriver::SourceEdit { batch[end].from, batch[end].to, batch[end].text });
+            end++;
+        }
+
+        enqueue(Priority::STATE, [filePath, edits](typstdriver::Engine* engine) {
+            engine->applyContentEdits(filePath, edits);
+        });
+        d_editStatistics.sent += edits.size();
+        d_editStatistics.batches++;
+        start = end;
+    }
+}
+
+void TypstDriverWrapper::closeFile(const QString& filePath)
+{
+    if (d_status == Status::INITIALIZING) {
+        d_pendingEdits.removeIf([&filePath](const PendingEdit& edit) { return edit.filePath == filePath; });
+        d_pendingFileSources.insert(filePath, std::nullopt);
+        return;
+    }
+
+    enqueue(Priority::STATE, [filePath](typstdriver::Engine* engine) { engine->closeFile(filePath); });
 }
 
 void TypstDriverWrapper::updatePreview()
 {
     if (d_status == Status::PROCESSING) {
-        qDebug() << "Compiler already processing, skipping";
+        // Edits made since the running compilation started are already
+        // queued for the engine. Make sure they are compiled once it is done,
+        // but only once no matter how many requests come in meanwhile.
+        d_followUpCompilePending = true;
         return;
     }
     else if (d_status == Status::INITIALIZING) {
         return;
     }
 
+    startCompile();
+}
+
+void TypstDriverWrapper::startCompile()
+{
+    d_followUpCompilePending = false;
     d_status = Status::PROCESSING;
     Q_EMIT compilationStatusChanged();
 
     d_diagnosticsModel->clear();
-    QMetaObject::invokeMethod(d_engine, &typstdriver::Engine::compile);
+    d_compileTimer.start();
+    enqueue(Priority::COMPILE, [](typstdriver::Engine* engine) { engine->compile(); });
 }
 
-void TypstDriverWrapper::renderPage(int page, qreal pointSize)
+void TypstDriverWrapper::enqueue(
+    DriverRequestQueue::Priority priority,
+    std::function<void(typstdriver::Engine*)> request,
+    const QString& key)
 {
-    if (d_pendingPagesToRender.contains(page)) {
+    if (d_engine == nullptr) {
         return;
     }
 
-    d_pendingPagesToRender.insert(page);
-    QMetaObject::invokeMethod(d_engine, &typstdriver::Engine::renderPage, page, pointSize);
+    // Batched edits must reach the engine before anything requested after them
+    flushEditBatch();
+
+    typstdriver::Engine* engine = d_engine;
+    d_requestQueue->push(priority, [engine, request]() { request(engine); }, key);
+
+    // Every request posts one delivery event to the engine's thread, but each
+    // such event runs whatever request is the most urgent at that time. That
+    // way queries the user waits for skip ahead of long queued background
+    // work, and superseded requests are simply never run.
+    std::shared_ptr<DriverRequestQueue> queue = d_requestQueue;
+    QMetaObject::invokeMethod(d_engine, [queue]() { queue->runNext(); });
+}
+
+void TypstDriverWrapper::updatePreviewDelay()
+{
+    int delay = d_settings->previewDelay();
+    if (delay == typstdriver::TypstCompilerSettings::ADAPTIVE_PREVIEW_DELAY) {
+        if (d_recentCompileDurations.isEmpty()) {
+            delay = DEFAULT_PREVIEW_DELAY_MS;
+        }
+        else {
+            // Wait roughly as long as a compilation takes: small documents get
+            // an almost immediate preview, while large ones are not recompiled
+            // on every pause in typing. The median ignores one-off outliers
+            // such as the first compilation filling up the caches.
+            QList<qint64> durations = d_recentCompileDurations;
+            auto middle = durations.begin() + durations.size() / 2;
+            std::nth_element(durations.begin(), middle, durations.end());
+
+            delay = static_cast<int>(qBound<qint64>(MIN_ADAPTIVE_PREVIEW_DELAY_MS, *middle, MAX_ADAPTIVE_PREVIEW_DELAY_MS));
+        }
+    }
+
+    if (delay != d_previewDelay) {
+        d_previewDelay = delay;
+        Q_EMIT previewDelayChanged(delay);
+    }
+}
+
+static QString quickRenderKey(int page)
+{
+    return QStringLiteral("quick/%1").arg(page);
+}
+
+static QString prefetchKey(int page)
+{
+    return QStringLiteral("prefetch/%1").arg(page);
+}
+
+static QString pictureRenderKey(int page)
+{
+    return QStringLiteral("picture/%1").arg(page);
+}
+
+void TypstDriverWrapper::renderPage(int page, qreal pointSize, bool withQuickPass)
+{
+    auto it = d_pendingPagesToRender.constFind(page);
+    if (it != d_pendingPagesToRender.cend()) {
+        if (it.value() == pointSize) {
+            return;
+        }
+
+        // The page is wanted at a different zoom level now. Queued requests
+        // are replaced below, but ones already given to the engine must be
+        // stopped explicitly.
+        d_engine->cancelPageRenders(page, pointSize);
+    }
+
+    auto prefetch = d_pendingPrefetches.constFind(page);
+    if (prefetch != d_pendingPrefetches.cend()) {
+        bool sameSize = prefetch.value() == pointSize;
+        bool started = !d_requestQueue->remove(Priority::BACKGROUND, prefetchKey(page));
+        d_pendingPrefetches.erase(prefetch);
+
+        // The page became visible before the engine got to prefetching it,
+        // or while doing so. In the latter case just wait for the result.
+        if (started && sameSize) {
+            d_pendingPagesToRender.insert(page, pointSize);
+            return;
+        }
+        else if (started) {
+            d_engine->cancelPageRenders(page, pointSize);
+        }
+    }
+
+    d_pendingPagesToRender.insert(page, pointSize);
+    if (withQuickPass) {
+        qreal quickPointSize = pointSize * QUICK_RENDER_SCALE;
+        enqueue(Priority::RENDER, [page, quickPointSize, invert = d_invertPreviewColors](typstdriver::Engine* engine) {
+            engine->renderPage(page, quickPointSize, invert);
+        }, quickRenderKey(page));
+    }
+    enqueue(Priority::RENDER, [page, pointSize, invert = d_invertPreviewColors](typstdriver::Engine* engine) {
+        engine->renderPage(page, pointSize, invert);
+    }, QString::number(page));
+}
+
+void TypstDriverWrapper::discardRenderRequestsOutside(int firstPage, int lastPage)
+{
+    for (auto it = d_pendingPagesToRender.begin(); it != d_pendingPagesToRender.end(); ) {
+        int page = it.key();
+        if ((page < firstPage || page > lastPage) && d_requestQueue->remove(Priority::RENDER, QString::number(page))) {
+            d_requestQueue->remove(Priority::RENDER, quickRenderKey(page));
+            it = d_pendingPagesToRender.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+
+    for (auto it = d_pendingPicturesToRender.begin(); it != d_pendingPicturesToRender.end(); ) {
+        int page = *it;
+        if ((page < firstPage || page > lastPage) && d_requestQueue->remove(Priority::RENDER, pictureRenderKey(page))) {
+            it = d_pendingPicturesToRender.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+void TypstDriverWrapper::prefetchPages(const QHash<int, qreal>& pages)
+{
+    // Prefetches that are no longer wanted need not run
+    for (auto it = d_pendingPrefetches.begin(); it != d_pendingPrefetches.end(); ) {
+        auto wanted = pages.constFind(it.key());
+        if ((wanted == pages.cend() || wanted.value() != it.value())
+            && d_requestQueue->remove(Priority::BACKGROUND, prefetchKey(it.key()))) {
+            it = d_pendingPrefetches.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+
+    for (auto it = pages.cbegin(); it != pages.cend(); ++it) {
+        int page = it.key();
+        qreal pointSize = it.value();
+        if (d_pendingPagesToRender.contains(page) || d_pendingPrefetches.contains(page)) {
+            continue;
+        }
+
+        d_pendingPrefetches.insert(page, pointSize);
+        enqueue(Priority::BACKGROUND, [page, pointSize, invert = d_invertPreviewColors](typstdriver::Engine* engine) {
+            engine->renderPage(page, pointSize, invert);
+        }, prefetchKey(page));
+    }
+}
+
+static QString tileRenderKey(int page, QRect tile)
+{
+    return QStringLiteral("%1:%2,%3").arg(page).arg(tile.x()).arg(tile.y());
+}
+
+void TypstDriverWrapper::renderTile(int page, qreal pointSize, QRect tile)
+{
+    // A pending request for the same tile at a different zoom level is
+    // replaced, as it is keyed only by position.
+    QString key = tileRenderKey(page, tile);
+    auto it = d_pendingTilesToRender.constFind(key);
+    if (it != d_pendingTilesToRender.cend() && it->pointSize == pointSize && it->tile == tile) {
+        return;
+    }
+
+    d_pendingTilesToRender.insert(key, PendingTile { page, pointSize, tile });
+    enqueue(Priority::RENDER, [page, pointSize, tile, invert = d_invertPreviewColors](typstdriver::Engine* engine) {
+        engine->renderTile(page, pointSize, tile, invert);
+    }, key);
+}
+
+void TypstDriverWrapper::discardTileRequestsOutside(const QHash<int, QRect>& visibleAreas)
+{
+    for (auto it = d_pendingTilesToRender.begin(); it != d_pendingTilesToRender.end(); ) {
+        auto area = visibleAreas.constFind(it->page);
+        bool visible = area != visibleAreas.cend() && area->intersects(it->tile);
+        if (!visible && d_requestQueue->remove(Priority::RENDER, it.key())) {
+            it = d_pendingTilesToRender.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+void TypstDriverWrapper::renderPagePicture(int page)
+{
+    if (d_pendingPicturesToRender.contains(page)) {
+        return;
+    }
+
+    d_pendingPicturesToRender.insert(page);
+    enqueue(Priority::RENDER, [page, invert = d_invertPreviewColors](typstdriver::Engine* engine) {
+        engine->renderPagePicture(page, invert);
+    }, pictureRenderKey(page));
+}
+
+void TypstDriverWrapper::discardPictureFonts()
+{
+    enqueue(Priority::STATE, [](typstdriver::Engine* engine) { engine->discardPictureFonts(); });
 }
 
 void TypstDriverWrapper::exportToPdf(const QString& filePath)
@@ -192,59 +552,75 @@ void TypstDriverWrapper::exportToPdf(const QString& filePath)
 void TypstDriverWrapper::exportToPdf(const QString& filePath, const QString& pdfVersion, const QString& pdfaStandard, bool tagged)
 {
     d_diagnosticsModel->clear();
-    QMetaObject::invokeMethod(d_engine, &typstdriver::Engine::exportToPdf, filePath, pdfVersion, pdfaStandard, tagged);
+    enqueue(Priority::COMPILE, [filePath, pdfVersion, pdfaStandard, tagged](typstdriver::Engine* engine) {
+        engine->exportToPdf(filePath, pdfVersion, pdfaStandard, tagged);
+    });
 }
 
 void TypstDriverWrapper::exportToPng(const QString& filePath, int dpi)
 {
     d_diagnosticsModel->clear();
-    QMetaObject::invokeMethod(d_engine, &typstdriver::Engine::exportToPng, filePath, dpi);
+    enqueue(Priority::COMPILE, [filePath, dpi](typstdriver::Engine* engine) { engine->exportToPng(filePath, dpi); });
 }
 
 void TypstDriverWrapper::exportToPngMulti(const QString& dir, const QString& filePattern, int dpi)
 {
     d_diagnosticsModel->clear();
-    QMetaObject::invokeMethod(d_engine, &typstdriver::Engine::exportToPngMulti, dir, filePattern, dpi);
+    enqueue(Priority::COMPILE, [dir, filePattern, dpi](typstdriver::Engine* engine) {
+        engine->exportToPngMulti(dir, filePattern, dpi);
+    });
 }
 
 void TypstDriverWrapper::forwardSearch(int line, int column, int currentPreviewPage)
 {
-    QMetaObject::invokeMethod(d_engine, &typstdriver::Engine::forwardSearch, line, column, currentPreviewPage);
+    enqueue(Priority::INTERACTIVE, [line, column, currentPreviewPage](typstdriver::Engine* engine) {
+        engine->forwardSearch(line, column, currentPreviewPage);
+    }, QStringLiteral("forwardSearch"));
 }
 
 void TypstDriverWrapper::inverseSearch(int page, QPointF clickPoint)
 {
-    QMetaObject::invokeMethod(d_engine, &typstdriver::Engine::inverseSearch, page, clickPoint);
+    enqueue(Priority::INTERACTIVE, [page, clickPoint](typstdriver::Engine* engine) {
+        engine->inverseSearch(page, clickPoint);
+    }, QStringLiteral("inverseSearch"));
 }
 
 void TypstDriverWrapper::requestToolTip(int line, int column)
 {
-    QMetaObject::invokeMethod(d_engine, &typstdriver::Engine::requestToolTip, line, column);
+    enqueue(Priority::INTERACTIVE, [line, column](typstdriver::Engine* engine) {
+        engine->requestToolTip(line, column);
+    }, QStringLiteral("toolTip"));
 }
 
 void TypstDriverWrapper::requestCompletions(int line, int column, bool implicit)
 {
-    QMetaObject::invokeMethod(d_engine, &typstdriver::Engine::requestCompletions, line, column, implicit);
+    enqueue(Priority::INTERACTIVE, [line, column, implicit](typstdriver::Engine* engine) {
+        engine->requestCompletions(line, column, implicit);
+    }, QStringLiteral("completions"));
 }
 
 void TypstDriverWrapper::searchDefinition(int line, int column)
 {
-    QMetaObject::invokeMethod(d_engine, &typstdriver::Engine::searchDefinition, line, column);
+    enqueue(Priority::INTERACTIVE, [line, column](typstdriver::Engine* engine) {
+        engine->searchDefinition(line, column);
+    }, QStringLiteral("definition"));
 }
 
 void TypstDriverWrapper::requestPageWordCount(int page)
 {
-    QMetaObject::invokeMethod(d_engine, &typstdriver::Engine::requestPageWordCount, page);
+    enqueue(Priority::BACKGROUND, [page](typstdriver::Engine* engine) {
+        engine->requestPageWordCount(page);
+    }, QStringLiteral("wordCount/%1").arg(page));
 }
 
 void TypstDriverWrapper::requestAllSymbolsJson()
 {
-    QMetaObject::invokeMethod(d_engine, &typstdriver::Engine::requestAllSymbolsJson);
+    enqueue(Priority::BACKGROUND, [](typstdriver::Engine* engine) { engine->requestAllSymbolsJson(); });
 }
 
 void TypstDriverWrapper::discardLookupCaches()
 {
-    QMetaObject::invokeMethod(d_engine, &typstdriver::Engine::discardLookupCaches);
+    enqueue(Priority::STATE, [](typstdriver::Engine* engine) { engine->discardLookupCaches(); });
 }
 
 void TypstDriverWrapper::compilationFinished()
@@ -252,16 +628,125 @@ void TypstDriverWrapper::compilationFinished()
     d_status = d_diagnosticsModel->impliedStatus();
     Q_EMIT compilationStatusChanged();
 
+    if (d_compileTimer.isValid()) {
+        d_recentCompileDurations.append(d_compileTimer.elapsed());
+        if (d_recentCompileDurations.size() > COMPILE_DURATION_WINDOW) {
+            d_recentCompileDurations.removeFirst();
+        }
+        d_compileTimer.invalidate();
+        updatePreviewDelay();
+    }
+
+    if (d_followUpCompilePending) {
+        // The document changed while compiling, so this result is already
+        // outdated. Don't spend time extracting metadata from it.
+        startCompile();
+        return;
+    }
+
     if (d_status == Status::SUCCESS || d_status == Status::SUCCESS_WITH_WARNINGS) {
         // TODO: Possibly throttle this
-        QMetaObject::invokeMethod(d_engine, &typstdriver::Engine::requestMetadata, d_lastMetadataFingerprint);
+        enqueue(Priority::BACKGROUND, [fingerprint = d_lastMetadataFingerprint](typstdriver::Engine* engine) {
+            engine->requestMetadata(fingerprint);
+        }, QStringLiteral("metadata"));
+    }
+}
+
+void TypstDriverWrapper::compilationStatisticsReady(katvan::typstdriver::CompileStatistics statistics)
+{
+    if (d_statisticsLogFile.isEmpty()) {
+        return;
+    }
+
+    // One JSON object per line, for easy consumption by scripts
+    QJsonObject obj;
+    obj[QStringLiteral("timestamp")] = QDateTime::currentDateTime().toString(Qt::ISODateWithMs);
+    obj[QStringLiteral("success")] = statistics.success;
+    obj[QStringLiteral("pages")] = statistics.pages;
+    obj[QStringLiteral("edits")] = statistics.edits;
+    obj[QStringLiteral("editsNsecs")] = statistics.editsNsecs;
+    obj[QStringLiteral("typstNsecs")] = statistics.typstNsecs;
+    obj[QStringLiteral("evictionNsecs")] = statistics.evictionNsecs;
+    obj[QStringLiteral("fingerprintNsecs")] = statistics.fingerprintNsecs;
+    obj[QStringLiteral("marshalingNsecs")] = statistics.marshalingNsecs;
+    obj[QStringLiteral("filesCached")] = statistics.filesCached;
+    obj[QStringLiteral("filesRead")] = statistics.filesRead;
+    obj[QStringLiteral("cacheMaxAge")] = statistics.cacheMaxAge;
+    if (statistics.residentBytes > 0) {
+        obj[QStringLiteral("residentBytes")] = statistics.residentBytes;
     }
+    obj[QStringLiteral("editorEditsReceived")] = static_cast<qint64>(d_editStatistics.received);
+    obj[QStringLiteral("editorEditsCoalesced")] = static_cast<qint64>(d_editStatistics.coalesced);
+    obj[QStringLiteral("editorEditsSent")] = static_cast<qint64>(d_editStatistics.sent);
+    obj[QStringLiteral("editorEditBatches")] = static_cast<qint64>(d_editStatistics.batches);
+    if (d_compileTimer.isValid()) {
+        obj[QStringLiteral("roundTripMsecs")] = d_compileTimer.elapsed();
+    }
+
+    QFile file { d_statisticsLogFile };
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)) {
+        qWarning() << "Failed to open compile statistics log" << d_statisticsLogFile << ":" << file.errorString();
+        d_statisticsLogFile.clear();
+        return;
+    }
+    file.write(QJsonDocument(obj).toJson(QJsonDocument::Compact));
+    file.write("\n");
 }
 
-void TypstDriverWrapper::pageRenderComplete(int page, QImage renderedPage)
+void TypstDriverWrapper::previewReadyInternal(QList<katvan::typstdriver::PreviewPageData> pages)
 {
-    d_pendingPagesToRender.remove(page);
-    Q_EMIT pageRendered(page, renderedPage);
+    // The engine drops renders of the previous result that were still in
+    // progress, so they must not block rendering the same pages again.
+    d_pendingPagesToRender.clear();
+    d_pendingPrefetches.clear();
+    d_pendingTilesToRender.clear();
+    d_pendingPicturesToRender.clear();
+    Q_EMIT previewReady(pages);
+}
+
+void TypstDriverWrapper::pageRenderComplete(int page, qreal pointSize, bool invertColors, QImage renderedPage)
+{
+    if (invertColors != d_invertPreviewColors) {
+        return;
+    }
+
+    // Quick passes and renders for a previous zoom level don't complete the
+    // pending request
+    auto it = d_pendingPagesToRender.constFind(page);
+    if (it != d_pendingPagesToRender.cend() && it.value() == pointSize) {
+        d_pendingPagesToRender.erase(it);
+    }
+
+    auto prefetch = d_pendingPrefetches.constFind(page);
+    if (prefetch != d_pendingPrefetches.cend() && prefetch.value() == pointSize) {
+        d_pendingPrefetches.erase(prefetch);
+    }
+    Q_EMIT pageRendered(page, pointSize, renderedPage);
+}
+
+void TypstDriverWrapper::tileRenderComplete(int page, qreal pointSize, QRect tile, bool invertColors, QImage renderedTile)
+{
+    if (invertColors != d_invertPreviewColors) {
+        return;
+    }
+
+    // Only forget the request if it wasn't replaced meanwhile
+    QString key = tileRenderKey(page, tile);
+    auto it = d_pendingTilesToRender.constFind(key);
+    if (it != d_pendingTilesToRender.cend() && it->pointSize == pointSize && it->tile == tile) {
+        d_pendingTilesToRender.erase(it);
+    }
+    Q_EMIT tileRendered(page, pointSize, tile, renderedTile);
+}
+
+void TypstDriverWrapper::pagePictureComplete(int page, bool invertColors, QPicture picture)
+{
+    if (invertColors != d_invertPreviewColors) {
+        return;
+    }
+
+    d_pendingPicturesToRender.remove(page);
+    Q_EMIT pagePictureRendered(page, picture);
 }
 
 void TypstDriverWrapper::metadataUpdatedInternal(
@@ -17,13 +17,20 @@
  */
 #pragma once
 
+#include "katvan_driverrequestqueue.h"
+#include "katvan_editbatch.h"
+
 #include "typstdriver_engine.h"
 #include "typstdriver_logger.h"
 
+#include <QElapsedTimer>
+#include <QHash>
 #include <QList>
 #include <QObject>
+#include <QRect>
 #include <QSet>
 
+#include <functional>
 #include <memory>
 #include <optional>
 
@@ -54,6 +61,17 @@ public:
         FAILED
     };
 
+    struct EditStatistics {
+        quint64 received = 0;
+        quint64 coalesced = 0;
+        quint64 sent = 0;
+        quint64 batches = 0;
+    };
+
+    // Resolution of the quick first pass of a page render, relative to the
+    // requested one
+    static constexpr qreal QUICK_RENDER_SCALE = 0.25;
+
 public:
     TypstDriverWrapper(QObject* parent = nullptr);
     ~TypstDriverWrapper();
@@ -61,15 +79,22 @@ public:
     static QString typstVersion();
 
     Status status() const { return d_status; }
+    int previewDelay() const { return d_previewDelay; }
+    EditStatistics editStatistics() const { return d_editStatistics; }
     DiagnosticsModel* diagnosticsModel() { return d_diagnosticsModel; }
 
     void setCompilerSettings(const typstdriver::TypstCompilerSettings& settings);
+    void setStatisticsLogFile(const QString& filePath);
+    void setInvertPreviewColors(bool invert);
     void resetInputFile(const QString& sourceFileName);
 
 signals:
     void previewReady(QList<katvan::typstdriver::PreviewPageData> pages);
     void compilationStatusChanged();
-    void pageRendered(int page, QImage renderedPage);
+    void previewDelayChanged(int msecs);
+    void pageRendered(int page, qreal pointSize, QImage renderedPage);
+    void tileRendered(int page, qreal pointSize, QRect tile, QImage renderedTile);
+    void pagePictureRendered(int page, QPicture picture);
     void exportFinished(bool success);
     void jumpToPreview(int page, QPointF pos);
     void jumpToEditor(int line, int column);
@@ -83,8 +108,17 @@ signals:
 public slots:
     void setSource(const QString& text);
     void applyContentEdit(int from, int to, QString text);
+    void setFileSource(const QString& filePath, const QString& text);
+    void applyFileContentEdit(const QString& filePath, int from, int to, QString text);
+    void closeFile(const QString& filePath);
     void updatePreview();
-    void renderPage(int page, qreal pageSize);
+    void renderPage(int page, qreal pointSize, bool withQuickPass = false);
+    void discardRenderRequestsOutside(int firstPage, int lastPage);
+    void prefetchPages(const QHash<int, qreal>& pages);
+    void renderTile(int page, qreal pointSize, QRect tile);
+    void discardTileRequestsOutside(const QHash<int, QRect>& visibleAreas);
+    void renderPagePicture(int page);
+    void discardPictureFonts();
     void exportToPdf(const QString& filePath);
     void exportToPdf(const QString& filePath, const QString& pdfVersion, const QString& pdfaStandard, bool tagged);
     void exportToPng(const QString& filePath, int dpi);
@@ -100,31 +134,59 @@ public slots:
 
 private slots:
     void compilationFinished();
-    void pageRenderComplete(int page, QImage renderedPage);
+    void compilationStatisticsReady(katvan::typstdriver::CompileStatistics statistics);
+    void previewReadyInternal(QList<katvan::typstdriver::PreviewPageData> pages);
+    void pageRenderComplete(int page, qreal pointSize, bool invertColors, QImage renderedPage);
+    void tileRenderComplete(int page, qreal pointSize, QRect tile, bool invertColors, QImage renderedTile);
+    void pagePictureComplete(int page, bool invertColors, QPicture picture);
     void metadataUpdatedInternal(quint64 fingerprint, katvan::typstdriver::OutlineNode* outline, QList<katvan::typstdriver::DocumentLabel> labels);
 
 private:
-    struct PendingEdit
+    using PendingEdit = EditBatch::Edit;
+
+    struct PendingTile
     {
-        int from;
-        int to;
-        QString text;
+        int page;
+        qreal pointSize;
+        QRect tile;
     };
 
+    void enqueue(
+        DriverRequestQueue::Priority priority,
+        std::function<void(typstdriver::Engine*)> request,
+        const QString& key = QString());
+    void startCompile();
+    void appendToEditBatch(const PendingEdit& edit);
+    void flushEditBatch();
+    void updatePreviewDelay();
+
     typstdriver::Engine* d_engine;
     typstdriver::Logger* d_compilerLogger;
     typstdriver::PackageManager* d_packageManager;
 
     DiagnosticsModel* d_diagnosticsModel;
     QThread* d_thread;
+    std::shared_ptr<DriverRequestQueue> d_requestQueue;
 
     Status d_status;
+    bool d_followUpCompilePending;
+    QElapsedTimer d_compileTimer;
+    QList<qint64> d_recentCompileDurations;
+    int d_previewDelay;
     std::shared_ptr<typstdriver::TypstCompilerSettings> d_settings;
     std::optional<QString> d_pendingSource;
     QList<PendingEdit> d_pendingEdits;
+    EditBatch d_editBatch;
+    EditStatistics d_editStatistics;
+    QString d_statisticsLogFile;
+    QHash<QString, std::optional<QString>> d_pendingFileSources;
     quint64 d_lastMetadataFingerprint;
 
-    QSet<int> d_pendingPagesToRender;
+    bool d_invertPreviewColors;
+    QHash<int, qreal> d_pendingPagesToRender;
+    QHash<int, qreal> d_pendingPrefetches;
+    QHash<QString, PendingTile> d_pendingTilesToRender;
+    QSet<int> d_pendingPicturesToRender;
 };
 
 }
@@ -19,11 +19,16 @@
 #import "macshell_widgets.h"
 
 #include <QScrollBar>
+#include <QSettings>
 
 static const NSInteger kZoomLevelFitPage = -1;
 static const NSInteger kZoomLevelFitWidth = -2;
 static const NSSize kPageNumberLabelPadding = NSMakeSize(8, 8);
 
+static constexpr QLatin1StringView SETTING_PREVIEW_CACHE_BUDGET("preview/cache-budget");
+static constexpr QLatin1StringView SETTING_PREVIEW_CACHE_COMPRESSED("preview/cache-keep-compressed");
+static constexpr QLatin1StringView SETTING_PREVIEW_VECTOR_MODE("preview/vector-mode");
+
 @interface PageNumberLabelCell : NSTextFieldCell
 @property (nonatomic) BOOL active;
 @end
@@ -93,6 +98,18 @@ static const NSSize kPageNumberLabelPadding = NSMakeSize(8, 8);
         self.identifier = [self className];
         self.previewerView = new katvan::PreviewerView(driver);
 
+        // Not exposed in the UI, for tuning memory use on constrained systems
+        QSettings settings;
+        int cacheBudget = settings.value(SETTING_PREVIEW_CACHE_BUDGET, katvan::PreviewerView::DEFAULT_RENDER_CACHE_BUDGET).toInt();
+        self.previewerView->setRenderCacheBudget(cacheBudget);
+
+        bool keepCompressed = settings.value(SETTING_PREVIEW_CACHE_COMPRESSED, true).toBool();
+        self.previewerView->setKeepCompressedPages(keepCompressed);
+
+        // Experimental, also not exposed in the UI yet
+        bool vectorMode = settings.value(SETTING_PREVIEW_VECTOR_MODE, false).toBool();
+        self.previewerView->setVectorMode(vectorMode);
+
         __weak __typeof__(self) weakSelf = self;
 
         QObject::connect(driver, &katvan::TypstDriverWrapper::previewReady,
@@ -324,6 +324,9 @@ static void addSeparatorRow(NSGridView* grid)
 
 @property (nonatomic) NSButton* allowPreviewPackagesCheckbox;
 @property (nonatomic) NSButton* enableA11yCheckbox;
+@property (nonatomic) NSButton* adaptivePreviewDelayCheckbox;
+@property (nonatomic) KatvanSpinBox* previewDelaySpinBox;
+@property (nonatomic) KatvanSpinBox* cacheMaxAgeSpinBox;
 @property (nonatomic) NSTextField* cacheSizeLabel;
 
 @property (nonatomic) NSTableView* pathsTableView;
@@ -344,6 +347,24 @@ static void addSeparatorRow(NSGridView* grid)
                                         target:self
                                         action:@selector(settingsChanged:)];
 
+    self.adaptivePreviewDelayCheckbox = [NSButton checkboxWithTitle:NSLocalizedString(@"Adapt to recent compilation times", "Compiler setting label")
+                                                  target:self
+                                                  action:@selector(previewDelayModeChanged:)];
+
+    self.previewDelaySpinBox = [[KatvanSpinBox alloc] init];
+    self.previewDelaySpinBox.minimum = 50;
+    self.previewDelaySpinBox.maximum = 5000;
+    self.previewDelaySpinBox.increment = 50;
+    self.previewDelaySpinBox.value = 500;
+    self.previewDelaySpinBox.target = self;
+    self.previewDelaySpinBox.action = @selector(settingsChanged:);
+
+    self.cacheMaxAgeSpinBox = [[KatvanSpinBox alloc] init];
+    self.cacheMaxAgeSpinBox.minimum = 1;
+    self.cacheMaxAgeSpinBox.maximum = 100;
+    self.cacheMaxAgeSpinBox.target = self;
+    self.cacheMaxAgeSpinBox.action = @selector(settingsChanged:);
+
     self.cacheSizeLabel = [NSTextField labelWithString:@""];
 
     NSButton* browseCacheButton = [NSButton buttonWithTitle:NSLocalizedString(@"Browse...", "Button in compiler settings to open download cache")
@@ -366,6 +387,11 @@ static void addSeparatorRow(NSGridView* grid)
 
     addControlRow(grid, self.allowPreviewPackagesCheckbox, NSLocalizedString(@"Compiler flags:", "Compiler setting label"));
     addControlRow(grid, self.enableA11yCheckbox, nil);
+    addSeparatorRow(grid);
+    addControlRow(grid, self.adaptivePreviewDelayCheckbox, NSLocalizedString(@"Preview update delay:", "Compiler setting label"));
+    addControlRow(grid, self.previewDelaySpinBox, NSLocalizedString(@"Fixed delay (ms):", "Compiler setting label"));
+    addControlRow(grid, self.cacheMaxAgeSpinBox, NSLocalizedString(@"Keep cached results for (compilations):", "Compiler setting label"));
+    addSeparatorRow(grid);
     addControlRow(grid, self.cacheSizeLabel, NSLocalizedString(@"Download cache:", "Compiler setting label"));
     addControlRow(grid, browseCacheButton, nil);
     addSeparatorRow(grid);
@@ -543,6 +569,17 @@ static void addSeparatorRow(NSGridView* grid)
     self.allowPreviewPackagesCheckbox.state = compilerSettings.allowPreviewPackages() ? NSControlStateValueOn : NSControlStateValueOff;
     self.enableA11yCheckbox.state = compilerSettings.enableA11yExtras() ? NSControlStateValueOn : NSControlStateValueOff;
 
+    // Live preview
+    int previewDelay = compilerSettings.previewDelay();
+    bool adaptive = previewDelay == katvan::typstdriver::TypstCompilerSettings::ADAPTIVE_PREVIEW_DELAY;
+    self.adaptivePreviewDelayCheckbox.state = adaptive ? NSControlStateValueOn : NSControlStateValueOff;
+    if (!adaptive) {
+        self.previewDelaySpinBox.value = previewDelay;
+    }
+
+    self.cacheMaxAgeSpinBox.value = compilerSettings.cacheMaxAge();
+    [self updateControlState];
+
     // Download cache size
     [self updateCacheSizeLabel];
 
@@ -563,6 +600,19 @@ static void addSeparatorRow(NSGridView* grid)
     compilerSettings.setAllowPreviewPackages(self.allowPreviewPackagesCheckbox.state == NSControlStateValueOn);
     compilerSettings.setEnableA11yExtras(self.enableA11yCheckbox.state == NSControlStateValueOn);
 
+    if (self.adaptivePreviewDelayCheckbox.state == NSControlStateValueOn) {
+        compilerSettings.setPreviewDelay(katvan::typstdriver::TypstCompilerSettings::ADAPTIVE_PREVIEW_DELAY);
+    }
+    else {
+        compilerSettings.setPreviewDelay(self.previewDelaySpinBox.value);
+    }
+
+    compilerSettings.setCacheMaxAge(self.cacheMaxAgeSpinBox.value);
+
+    // Memory use of the application is not measured on macOS, so the memory
+    // limit is not offered here. Keep whatever value is already stored.
+    compilerSettings.setCacheMemoryBudget(KatvanSettingsManager::instance().compilerSettings().cacheMemoryBudget());
+
     QStringList allowedPaths;
     NSArray<NSString*>* paths = self.allowedPathsController.arrangedObjects;
     for (NSString* path in paths) {
@@ -573,11 +623,22 @@ static void addSeparatorRow(NSGridView* grid)
     KatvanSettingsManager::instance().updateCompilerSettings(compilerSettings);
 }
 
+- (void)updateControlState
+{
+    self.previewDelaySpinBox.enabled = (self.adaptivePreviewDelayCheckbox.state == NSControlStateValueOff);
+}
+
 - (void)settingsChanged:(id)sender
 {
     [self saveSettings];
 }
 
+- (void)previewDelayModeChanged:(id)sender
+{
+    [self updateControlState];
+    [self settingsChanged:sender];
+}
+
 @end
 
 @interface KatvanSettingsTabController : NSTabViewController
@@ -34,6 +34,7 @@
 
 @property (nonatomic, assign) NSInteger minimum;
 @property (nonatomic, assign) NSInteger maximum;
+@property (nonatomic, assign) NSInteger increment;
 @property (nonatomic, assign) NSInteger value;
 @property (nonatomic, assign) BOOL enabled;
 @property (nonatomic, weak, nullable) id target;
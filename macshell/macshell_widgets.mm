@@ -94,6 +94,7 @@
     if (self) {
         _minimum = 0;
         _maximum = 99;
+        _increment = 1;
         _value = 0;
 
         self.textField = [NSTextField textFieldWithString:@""];
@@ -107,7 +108,7 @@
         self.stepper.translatesAutoresizingMaskIntoConstraints = NO;
         self.stepper.minValue = _minimum;
         self.stepper.maxValue = _maximum;
-        self.stepper.increment = 1;
+        self.stepper.increment = _increment;
         self.stepper.integerValue = _value;
         self.stepper.valueWraps = NO;
         self.stepper.autorepeat = YES;
@@ -155,6 +156,12 @@
     self.value = _value;
 }
 
+- (void)setIncrement:(NSInteger)increment
+{
+    _increment = increment;
+    self.stepper.increment = increment;
+}
+
 - (void)setValue:(NSInteger)value
 {
     NSInteger clamped = qBound(_minimum, value, _maximum);
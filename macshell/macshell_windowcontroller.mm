@@ -28,11 +28,17 @@
 
 #include "katvan_completionmanager.h"
 #include "katvan_diagnosticsmodel.h"
+#include "katvan_documentregistry.h"
 #include "katvan_editor.h"
 #include "katvan_symbolpicker.h"
 #include "katvan_typstdriverwrapper.h"
 #include "katvan_wordcounter.h"
 
+#include <QSettings>
+
+static constexpr QLatin1StringView SETTING_EDITOR_PROFILER_OVERLAY("debug/editor-profiler-overlay");
+static constexpr QLatin1StringView SETTING_COMPILE_STATISTICS_LOG("debug/compile-statistics-log");
+
 @interface KatvanWindowController ()
 
 @property (nonatomic) NSSplitViewController* splitViewController;
@@ -95,6 +101,9 @@
 {
     [[NSNotificationCenter defaultCenter] removeObserver:self];
 
+    // The document outlives its window, so must not be tied to the driver
+    katvan::DocumentRegistry::instance().removeWindow(self.textDocument);
+
     delete self.wordCounter;
     delete self.driver;
 }
@@ -119,6 +128,9 @@
                      self.driver, &katvan::TypstDriverWrapper::applyContentEdit);
     QObject::connect(self.textDocument, &katvan::Document::contentModified,
                      self.driver, &katvan::TypstDriverWrapper::updatePreview);
+    QObject::connect(self.driver, &katvan::TypstDriverWrapper::previewDelayChanged,
+                     self.textDocument, &katvan::Document::setContentModifiedDelay);
+    katvan::DocumentRegistry::instance().addWindow(self.textDocument, self.driver);
 
     QObject::connect(self.driver, &katvan::TypstDriverWrapper::jumpToPreview,
                      self.previewer.previewerView, &katvan::PreviewerView::jumpTo);
@@ -324,6 +336,11 @@
 
     self.editorView.editor->applySettings(manager.editorSettings());
     self.driver->setCompilerSettings(manager.compilerSettings());
+
+    // Diagnostic aids, not exposed in the UI
+    QSettings settings;
+    self.editorView.editor->setProfilingEnabled(settings.value(SETTING_EDITOR_PROFILER_OVERLAY, false).toBool());
+    self.driver->setStatisticsLogFile(settings.value(SETTING_COMPILE_STATISTICS_LOG).toString());
 }
 
 - (void)documentDidExplicitlySaveInURL:(NSURL*)url forced:(BOOL)forced
@@ -337,6 +354,7 @@
         self.documentFilePath = filePath;
         self.driver->resetInputFile(filePath);
         self.driver->setSource(self.textDocument->textForPreview());
+        katvan::DocumentRegistry::instance().setFilePath(self.textDocument, filePath);
     }
 
     self.editorView.editor->checkForModelines();
@@ -32,6 +32,7 @@
 #include "katvan_completionmanager.h"
 #include "katvan_diagnosticsmodel.h"
 #include "katvan_document.h"
+#include "katvan_documentregistry.h"
 #include "katvan_editor.h"
 #include "katvan_editorsettings.h"
 #include "katvan_spellchecker.h"
@@ -70,6 +71,10 @@ static constexpr QLatin1StringView SETTING_SPELLING_DICT = QLatin1StringView("sp
 static constexpr QLatin1StringView SETTING_EDITOR_MODE = QLatin1StringView("editor/mode");
 static constexpr QLatin1StringView SETTING_LAST_OPENED_DIRECTORY = QLatin1StringView("lastOpenedDir");
 
+// Not exposed in the settings dialog - developer use only
+static constexpr QLatin1StringView SETTING_EDITOR_PROFILER_OVERLAY = QLatin1StringView("debug/editor-profiler-overlay");
+static constexpr QLatin1StringView SETTING_COMPILE_STATISTICS_LOG = QLatin1StringView("debug/compile-statistics-log");
+
 MainWindow::MainWindow()
     : QMainWindow(nullptr)
     , d_pendingExport(ExportType::NONE)
@@ -94,6 +99,8 @@ MainWindow::MainWindow()
 
     connect(d_document, &Document::contentEdited, d_driver, &TypstDriverWrapper::applyContentEdit);
     connect(d_document, &Document::contentModified, d_driver, &TypstDriverWrapper::updatePreview);
+    connect(d_driver, &TypstDriverWrapper::previewDelayChanged, d_document, &Document::setContentModifiedDelay);
+    DocumentRegistry::instance().addWindow(d_document, d_driver);
     connect(d_document, &QTextDocument::modificationChanged, this, &QMainWindow::setWindowModified);
 
     connect(d_driver, &TypstDriverWrapper::previewReady, this, &MainWindow::previewReady);
@@ -436,6 +443,8 @@ void MainWindow::readSettings()
         editorSettings = EditorSettings(mode, EditorSettings::ModeSource::SETTINGS);
     }
     d_editor->applySettings(editorSettings);
+    d_editor->setProfilingEnabled(settings.value(SETTING_EDITOR_PROFILER_OVERLAY, false).toBool());
+    d_driver->setStatisticsLogFile(settings.value(SETTING_COMPILE_STATISTICS_LOG).toString());
 
     d_backupHandler->setBackupInterval(editorSettings.autoBackupInterval());
     d_driver->setCompilerSettings(typstdriver::TypstCompilerSettings(settings));
@@ -532,6 +541,7 @@ void MainWindow::setCurrentFile(const QString& fileName)
 
     d_driver->resetInputFile(fileName);
     d_driver->setSource(d_document->textForPreview());
+    DocumentRegistry::instance().setFilePath(d_document, fileName);
 
     QString previousTmpFile = d_backupHandler->resetSourceFile(fileName);
     if (!previousTmpFile.isEmpty()) {
@@ -36,6 +36,9 @@ static constexpr QLatin1StringView FIT_TO_WIDTH("fit-width");
 static constexpr QLatin1StringView SETTING_PREVIEW_ZOOM("preview/zoom");
 static constexpr QLatin1StringView SETTING_PREVIEW_INVERT_COLORS("preview/invert-colors");
 static constexpr QLatin1StringView SETTING_PREVIEW_FOLLOW_CURSOR("preview/follow-cursor");
+static constexpr QLatin1StringView SETTING_PREVIEW_CACHE_BUDGET("preview/cache-budget");
+static constexpr QLatin1StringView SETTING_PREVIEW_CACHE_COMPRESSED("preview/cache-keep-compressed");
+static constexpr QLatin1StringView SETTING_PREVIEW_VECTOR_MODE("preview/vector-mode");
 
 namespace katvan {
 
@@ -180,6 +183,17 @@ void Previewer::restoreSettings(const QSettings& settings)
 
     bool followCursor = settings.value(SETTING_PREVIEW_FOLLOW_CURSOR, false).toBool();
     d_followEditorCursorAction->setChecked(followCursor);
+
+    // Not exposed in the UI, for tuning memory use on constrained systems
+    int cacheBudget = settings.value(SETTING_PREVIEW_CACHE_BUDGET, PreviewerView::DEFAULT_RENDER_CACHE_BUDGET).toInt();
+    d_view->setRenderCacheBudget(cacheBudget);
+
+    bool keepCompressed = settings.value(SETTING_PREVIEW_CACHE_COMPRESSED, true).toBool();
+    d_view->setKeepCompressedPages(keepCompressed);
+
+    // Experimental, also not exposed in the UI yet
+    bool vectorMode = settings.value(SETTING_PREVIEW_VECTOR_MODE, false).toBool();
+    d_view->setVectorMode(vectorMode);
 }
 
 void Previewer::saveSettings(QSettings& settings)
@@ -321,6 +321,31 @@ void CompilerSettingsTab::setupUI()
 {
     d_allowPreviewPackages = new QCheckBox(tr("&Allow download and use of @preview packages"));
     d_enableA11yExtras = new QCheckBox(tr("Enable experimental a&ccessibility features"));
+
+    d_previewDelay = new QSpinBox();
+    d_previewDelay->setRange(typstdriver::TypstCompilerSettings::ADAPTIVE_PREVIEW_DELAY, 5000);
+    d_previewDelay->setSuffix(tr(" ms"));
+    d_previewDelay->setSpecialValueText(tr("Adaptive"));
+    d_previewDelay->setSingleStep(50);
+    d_previewDelay->setToolTip(tr("How long to wait after the last edit before updating the preview. "
+                                  "Adaptive mode picks a delay based on how long recent compilations took."));
+
+    d_cacheMaxAge = new QSpinBox();
+    d_cacheMaxAge->setRange(1, 100);
+    d_cacheMaxAge->setSuffix(tr(" compilations"));
+    d_cacheMaxAge->setToolTip(tr("Intermediate results not reused for this many compilations are discarded. "
+                                 "Higher values use more memory, but can make editing large documents faster."));
+
+    d_cacheMemoryBudget = new QSpinBox();
+    d_cacheMemoryBudget->setRange(typstdriver::TypstCompilerSettings::UNLIMITED_CACHE_MEMORY, 256 * 1024);
+    d_cacheMemoryBudget->setSuffix(tr(" MB"));
+    d_cacheMemoryBudget->setSpecialValueText(tr("Unlimited"));
+    d_cacheMemoryBudget->setSingleStep(256);
+    d_cacheMemoryBudget->setToolTip(tr("When the application uses more memory than this, only intermediate results "
+                                       "of the last compilation are kept. This counts all memory used by the application, "
+                                       "including about 320 MB of rendered preview and editor pages, so very low limits "
+                                       "keep the cache from helping at all."));
+
     d_allowedPaths = new PathList();
     d_cacheSize = new QLabel();
 
@@ -334,6 +359,17 @@ void CompilerSettingsTab::setupUI()
     flagsLayout->addWidget(d_allowPreviewPackages);
     flagsLayout->addWidget(d_enableA11yExtras);
 
+    QGroupBox* previewGroup = new QGroupBox(tr("Live Preview"));
+    QFormLayout* previewLayout = new QFormLayout(previewGroup);
+    previewLayout->addRow(tr("&Update Delay:"), d_previewDelay);
+    previewLayout->addRow(tr("&Keep Cached Results For:"), d_cacheMaxAge);
+    previewLayout->addRow(tr("Cache &Memory Limit:"), d_cacheMemoryBudget);
+#if !defined(Q_OS_LINUX)
+    // Memory use of the application is only measured on Linux, the limit
+    // would have no effect elsewhere. The hidden row still keeps its value.
+    previewLayout->setRowVisible(d_cacheMemoryBudget, false);
+#endif
+
     QGroupBox* allowedPathsGroup = new QGroupBox(tr("Allowed Paths"));
     QVBoxLayout* allowedPathsLayout = new QVBoxLayout(allowedPathsGroup);
 
@@ -354,6 +390,7 @@ void CompilerSettingsTab::setupUI()
 
     QVBoxLayout* mainLayout = new QVBoxLayout(this);
     mainLayout->addWidget(flagsGroup);
+    mainLayout->addWidget(previewGroup);
     mainLayout->addWidget(allowedPathsGroup, 1);
     mainLayout->addWidget(downloadCacheGroup);
 }
@@ -364,6 +401,9 @@ typstdriver::TypstCompilerSettings CompilerSettingsTab::settings() const
     settings.setAllowPreviewPackages(d_allowPreviewPackages->isChecked());
     settings.setEnableA11yExtras(d_enableA11yExtras->isChecked());
     settings.setAllowedPaths(d_allowedPaths->paths());
+    settings.setPreviewDelay(d_previewDelay->value());
+    settings.setCacheMaxAge(d_cacheMaxAge->value());
+    settings.setCacheMemoryBudget(d_cacheMemoryBudget->value());
 
     return settings;
 }
@@ -373,6 +413,9 @@ void CompilerSettingsTab::setSettings(const typstdriver::TypstCompilerSettings&
     d_allowPreviewPackages->setChecked(settings.allowPreviewPackages());
     d_enableA11yExtras->setChecked(settings.enableA11yExtras());
     d_allowedPaths->setPaths(settings.allowedPaths());
+    d_previewDelay->setValue(settings.previewDelay());
+    d_cacheMaxAge->setValue(settings.cacheMaxAge());
+    d_cacheMemoryBudget->setValue(settings.cacheMemoryBudget());
 }
 
 void CompilerSettingsTab::showEvent(QShowEvent* event)
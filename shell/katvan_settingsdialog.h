@@ -114,6 +114,9 @@ private:
 
     QCheckBox* d_allowPreviewPackages;
     QCheckBox* d_enableA11yExtras;
+    QSpinBox* d_previewDelay;
+    QSpinBox* d_cacheMaxAge;
+    QSpinBox* d_cacheMemoryBudget;
     PathList* d_allowedPaths;
     QLabel* d_cacheSize;
 };
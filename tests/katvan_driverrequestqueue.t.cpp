@@ -0,0 +1,118 @@
+/*
+ * This file is part of Katvan
+ * Copyright (c) 2024 - 2026 Igor Khanin
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "katvan_testutils.h"
+
+#include "katvan_driverrequestqueue.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+using namespace katvan;
+
+using Priority = DriverRequestQueue::Priority;
+
+static void drain(DriverRequestQueue& queue)
+{
+    while (queue.runNext()) {
+    }
+}
+
+TEST(DriverRequestQueueTests, Empty) {
+    DriverRequestQueue queue;
+    EXPECT_THAT(queue.size(), ::testing::Eq(0));
+    EXPECT_THAT(queue.runNext(), ::testing::IsFalse());
+    EXPECT_THAT(static_cast<bool>(queue.takeNext()), ::testing::IsFalse());
+}
+
+TEST(DriverRequestQueueTests, Priorities) {
+    DriverRequestQueue queue;
+    QStringList order;
+
+    queue.push(Priority::BACKGROUND, [&]() { order.append(QStringLiteral("metadata")); });
+    queue.push(Priority::COMPILE, [&]() { order.append(QStringLiteral("compile")); });
+    queue.push(Priority::RENDER, [&]() { order.append(QStringLiteral("render 1")); });
+    queue.push(Priority::INTERACTIVE, [&]() { order.append(QStringLiteral("tooltip")); });
+    queue.push(Priority::RENDER, [&]() { order.append(QStringLiteral("render 2")); });
+    queue.push(Priority::STATE, [&]() { order.append(QStringLiteral("edit 1")); });
+    queue.push(Priority::STATE, [&]() { order.append(QStringLiteral("edit 2")); });
+    EXPECT_THAT(queue.size(), ::testing::Eq(7));
+
+    drain(queue);
+    EXPECT_THAT(queue.size(), ::testing::Eq(0));
+    EXPECT_THAT(order, ::testing::ElementsAre(
+        QStringLiteral("tooltip"),
+        QStringLiteral("edit 1"),
+        QStringLiteral("edit 2"),
+        QStringLiteral("render 1"),
+        QStringLiteral("render 2"),
+        QStringLiteral("compile"),
+        QStringLiteral("metadata")));
+}
+
+TEST(DriverRequestQueueTests, QueriesKeepOrderWithEdits) {
+    DriverRequestQueue queue;
+    QStringList order;
+
+    queue.push(Priority::BACKGROUND, [&]() { order.append(QStringLiteral("metadata")); });
+    queue.push(Priority::STATE, [&]() { order.append(QStringLiteral("edit 1")); });
+    queue.push(Priority::INTERACTIVE, [&]() { order.append(QStringLiteral("completions")); });
+    queue.push(Priority::STATE, [&]() { order.append(QStringLiteral("edit 2")); });
+    queue.push(Priority::INTERACTIVE, [&]() { order.append(QStringLiteral("tooltip")); });
+
+    drain(queue);
+    EXPECT_THAT(order, ::testing::ElementsAre(
+        QStringLiteral("edit 1"),
+        QStringLiteral("completions"),
+        QStringLiteral("edit 2"),
+        QStringLiteral("tooltip"),
+        QStringLiteral("metadata")));
+}
+
+TEST(DriverRequestQueueTests, SupersededByKey) {
+    DriverRequestQueue queue;
+    QList<int> handled;
+
+    queue.push(Priority::INTERACTIVE, [&]() { handled.append(1); }, QStringLiteral("completions"));
+    queue.push(Priority::INTERACTIVE, [&]() { handled.append(2); }, QStringLiteral("tooltip"));
+    queue.push(Priority::INTERACTIVE, [&]() { handled.append(3); }, QStringLiteral("completions"));
+    queue.push(Priority::BACKGROUND, [&]() { handled.append(4); }, QStringLiteral("completions"));
+    EXPECT_THAT(queue.size(), ::testing::Eq(3));
+
+    drain(queue);
+    EXPECT_THAT(handled, ::testing::ElementsAre(2, 3, 4));
+}
+
+TEST(DriverRequestQueueTests, Remove) {
+    DriverRequestQueue queue;
+    QList<int> handled;
+
+    queue.push(Priority::RENDER, [&]() { handled.append(1); }, QStringLiteral("1"));
+    queue.push(Priority::RENDER, [&]() { handled.append(2); }, QStringLiteral("2"));
+    queue.push(Priority::RENDER, [&]() { handled.append(3); }, QStringLiteral("3"));
+
+    EXPECT_THAT(queue.remove(Priority::RENDER, QStringLiteral("2")), ::testing::IsTrue());
+    EXPECT_THAT(queue.remove(Priority::RENDER, QStringLiteral("2")), ::testing::IsFalse());
+    EXPECT_THAT(queue.remove(Priority::COMPILE, QStringLiteral("3")), ::testing::IsFalse());
+
+    drain(queue);
+    EXPECT_THAT(handled, ::testing::ElementsAre(1, 3));
+
+    queue.push(Priority::STATE, [&]() { handled.append(4); });
+    queue.clear();
+    EXPECT_THAT(queue.runNext(), ::testing::IsFalse());
+}
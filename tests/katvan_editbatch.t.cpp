@@ -0,0 +1,190 @@
+/*
+ * This file is part of Katvan
+ * Copyright (c) 2024 - 2026 Igor Khanin
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "katvan_testutils.h"
+
+#include "katvan_editbatch.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+using namespace katvan;
+
+using Edit = EditBatch::Edit;
+
+static QString applyEdits(QString text, const QList<Edit>& edits)
+{
+    for (const Edit& edit : edits) {
+        text.replace(edit.from, edit.to - edit.from, edit.text);
+    }
+    return text;
+}
+
+/**
+ * Add edits to a batch one by one, checking that applying the batch has the
+ * same result as applying the original edits in order.
+ */
+static EditBatch batchEdits(const QString& text, const QList<Edit>& edits)
+{
+    EditBatch batch;
+    for (const Edit& edit : edits) {
+        batch.append(edit);
+    }
+
+    EXPECT_THAT(applyEdits(text, batch.edits()), ::testing::Eq(applyEdits(text, edits)));
+    return batch;
+}
+
+TEST(EditBatchTests, Empty) {
+    EditBatch batch;
+    EXPECT_THAT(batch.isEmpty(), ::testing::IsTrue());
+    EXPECT_THAT(batch.take(), ::testing::IsEmpty());
+}
+
+TEST(EditBatchTests, Typing) {
+    QString text = QStringLiteral("Hello World");
+
+    EditBatch batch = batchEdits(text, {
+        Edit { 5, 5, QStringLiteral(","), QString() },
+        Edit { 6, 6, QStringLiteral(" "), QString() },
+        Edit { 7, 7, QStringLiteral("dear"), QString() },
+    });
+
+    ASSERT_THAT(batch.size(), ::testing::Eq(1));
+    EXPECT_THAT(batch.edits()[0].from, ::testing::Eq(5));
+    EXPECT_THAT(batch.edits()[0].to, ::testing::Eq(5));
+    EXPECT_THAT(batch.edits()[0].text, ::testing::Eq(QStringLiteral(", dear")));
+}
+
+TEST(EditBatchTests, TouchingBefore) {
+    QString text = QStringLiteral("abcdef");
+
+    // Like an auto-closed bracket: the closing one first, then the opening
+    EditBatch batch = batchEdits(text, {
+        Edit { 3, 3, QStringLiteral(")"), QString() },
+        Edit { 3, 3, QStringLiteral("("), QString() },
+    });
+
+    ASSERT_THAT(batch.size(), ::testing::Eq(1));
+    EXPECT_THAT(batch.edits()[0].text, ::testing::Eq(QStringLiteral("()")));
+}
+
+TEST(EditBatchTests, Overlapping) {
+    QString text = QStringLiteral("0123456789");
+
+    // Second edit removes part of the first one's insertion and original
+    // text on either side of it
+    EditBatch batch = batchEdits(text, {
+        Edit { 4, 6, QStringLiteral("abc"), QString() },
+        Edit { 3, 6, QStringLiteral("X"), QString() },
+    });
+    ASSERT_THAT(batch.size(), ::testing::Eq(1));
+    EXPECT_THAT(batch.edits()[0].from, ::testing::Eq(3));
+    EXPECT_THAT(batch.edits()[0].to, ::testing::Eq(6));
+    EXPECT_THAT(batch.edits()[0].text, ::testing::Eq(QStringLiteral("Xc")));
+
+    batch = batchEdits(text, {
+        Edit { 4, 6, QStringLiteral("abc"), QString() },
+        Edit { 5, 9, QStringLiteral("Y"), QString() },
+    });
+    ASSERT_THAT(batch.size(), ::testing::Eq(1));
+    EXPECT_THAT(batch.edits()[0].from, ::testing::Eq(4));
+    EXPECT_THAT(batch.edits()[0].to, ::testing::Eq(8));
+    EXPECT_THAT(batch.edits()[0].text, ::testing::Eq(QStringLiteral("aY")));
+
+    // Second edit swallows the first one entirely
+    batch = batchEdits(text, {
+        Edit { 4, 5, QStringLiteral("abc"), QString() },
+        Edit { 2, 9, QString(), QString() },
+    });
+    ASSERT_THAT(batch.size(), ::testing::Eq(1));
+    EXPECT_THAT(batch.edits()[0].from, ::testing::Eq(2));
+    EXPECT_THAT(batch.edits()[0].to, ::testing::Eq(7));
+    EXPECT_THAT(batch.edits()[0].text, ::testing::IsEmpty());
+}
+
+TEST(EditBatchTests, Deletions) {
+    QString text = QStringLiteral("0123456789");
+
+    // Repeated backspace, then typing instead
+    EditBatch batch = batchEdits(text, {
+        Edit { 7, 8, QString(), QString() },
+        Edit { 6, 7, QString(), QString() },
+        Edit { 5, 6, QString(), QString() },
+        Edit { 5, 5, QStringLiteral("x"), QString() },
+    });
+
+    ASSERT_THAT(batch.size(), ::testing::Eq(1));
+    EXPECT_THAT(batch.edits()[0].from, ::testing::Eq(5));
+    EXPECT_THAT(batch.edits()[0].to, ::testing::Eq(8));
+    EXPECT_THAT(batch.edits()[0].text, ::testing::Eq(QStringLiteral("x")));
+}
+
+TEST(EditBatchTests, NonTouching) {
+    QString text = QStringLiteral("0123456789");
+
+    EditBatch batch = batchEdits(text, {
+        Edit { 1, 2, QStringLiteral("a"), QString() },
+        Edit { 5, 5, QStringLiteral("b"), QString() },
+        Edit { 0, 0, QStringLiteral("c"), QString() },
+    });
+    EXPECT_THAT(batch.size(), ::testing::Eq(3));
+}
+
+TEST(EditBatchTests, DifferentFiles) {
+    EditBatch batch;
+    EXPECT_THAT(batch.append(Edit { 0, 0, QStringLiteral("a"), QString() }), ::testing::IsFalse());
+    EXPECT_THAT(batch.append(Edit { 1, 1, QStringLiteral("b"), QStringLiteral("/other.typ") }), ::testing::IsFalse());
+    EXPECT_THAT(batch.append(Edit { 2, 2, QStringLiteral("c"), QStringLiteral("/other.typ") }), ::testing::IsTrue());
+    EXPECT_THAT(batch.append(Edit { 1, 1, QStringLiteral("d"), QString() }), ::testing::IsFalse());
+
+    ASSERT_THAT(batch.size(), ::testing::Eq(3));
+    EXPECT_THAT(batch.edits()[1].text, ::testing::Eq(QStringLiteral("bc")));
+}
+
+TEST(EditBatchTests, ReplaceAll) {
+    QString text = QStringLiteral("foo bar foo baz foo");
+
+    // One edit per match, each after the previous ones were applied
+    EditBatch batch = batchEdits(text, {
+        Edit { 0, 3, QStringLiteral("quux"), QString() },
+        Edit { 9, 12, QStringLiteral("quux"), QString() },
+        Edit { 18, 21, QStringLiteral("quux"), QString() },
+    });
+    EXPECT_THAT(batch.size(), ::testing::Eq(3));
+    EXPECT_THAT(applyEdits(text, batch.edits()), ::testing::Eq(QStringLiteral("quux bar quux baz quux")));
+
+    // Adjacent matches touch each other's replacement, so are merged
+    text = QStringLiteral("foofoo bar");
+    batch = batchEdits(text, {
+        Edit { 0, 3, QStringLiteral("x"), QString() },
+        Edit { 1, 4, QStringLiteral("x"), QString() },
+    });
+    ASSERT_THAT(batch.size(), ::testing::Eq(1));
+    EXPECT_THAT(batch.edits()[0].text, ::testing::Eq(QStringLiteral("xx")));
+    EXPECT_THAT(applyEdits(text, batch.edits()), ::testing::Eq(QStringLiteral("xx bar")));
+}
+
+TEST(EditBatchTests, Take) {
+    EditBatch batch;
+    batch.append(Edit { 0, 0, QStringLiteral("a"), QString() });
+    batch.append(Edit { 5, 5, QStringLiteral("b"), QString() });
+
+    QList<Edit> edits = batch.take();
+    EXPECT_THAT(edits.size(), ::testing::Eq(2));
+    EXPECT_THAT(batch.isEmpty(), ::testing::IsTrue());
+}
@@ -211,6 +211,42 @@ TEST(EditorTests, MoveToLineEdges) {
     EXPECT_THAT(p7, ::testing::Eq(p5));
 }
 
+TEST(EditorTests, MoveToLineEdgesWithIsolates) {
+    EditorSettings settings;
+
+    // Inline math gets an automatic isolate, so the block is shaped from
+    // display text with injected control characters.
+    QString text = QStringLiteral("  ") + QStringLiteral("long $x$ ").repeated(60);
+    EditorHolder holder(text, settings);
+
+    holder.editor->setFixedWidth(50);
+
+    constexpr int INITIAL_POSITION = 250;
+
+    holder.sendKeyPress(INITIAL_POSITION, QKeySequence::MoveToEndOfLine);
+
+    int p1 = holder.cursorPosition();
+    EXPECT_THAT(p1, ::testing::Gt(INITIAL_POSITION));
+    EXPECT_THAT(p1, ::testing::Ne(text.length()));
+
+    holder.sendKeyPress(p1, QKeySequence::MoveToEndOfLine);
+
+    int p2 = holder.cursorPosition();
+    EXPECT_THAT(p2, ::testing::Eq(text.length()));
+
+    holder.sendKeyPress(INITIAL_POSITION, QKeySequence::MoveToStartOfLine);
+
+    int p3 = holder.cursorPosition();
+    EXPECT_THAT(p3, ::testing::Lt(INITIAL_POSITION));
+    EXPECT_THAT(p3, ::testing::Ne(0));
+    EXPECT_THAT(p3, ::testing::Ne(2));
+
+    holder.sendKeyPress(p3, QKeySequence::MoveToStartOfLine);
+
+    int p4 = holder.cursorPosition();
+    EXPECT_THAT(p4, ::testing::Eq(2));
+}
+
 TEST(EditorTests, SelectToLineEdges) {
     EditorSettings settings;
 
@@ -17,7 +17,7 @@
  */
 use std::pin::Pin;
 
-use crate::engine::EngineImpl;
+use crate::engine::{EngineImpl, RenderSnapshot, invert_lightness};
 
 #[allow(clippy::needless_lifetimes)]
 #[cxx::bridge(namespace = "katvan::typstdriver")]
@@ -45,12 +45,100 @@ pub(crate) mod ffi {
         fingerprint: u64,
     }
 
+    struct ContentEdit {
+        from_utf16_idx: usize,
+        to_utf16_idx: usize,
+        text_len: usize,
+    }
+
+    #[derive(Default)]
+    struct CompileStats {
+        success: bool,
+        pages: usize,
+        edits: usize,
+        edits_nsecs: u64,
+        typst_nsecs: u64,
+        evict_nsecs: u64,
+        fingerprint_nsecs: u64,
+        files_cached: usize,
+        files_read: usize,
+        cache_max_age: usize,
+        resident_bytes: u64,
+    }
+
     struct RenderedPage {
         width_px: u32,
         height_px: u32,
         buffer: Vec<u8>,
     }
 
+    enum DisplayItemKind {
+        Glyphs,
+        Path,
+        Image,
+    }
+
+    /// A single drawing operation of a page's display list. Which fields are
+    /// meaningful depends on the kind: glyph runs use the fill color, font and
+    /// a range of glyphs; paths use the fill and stroke and a range of path
+    /// verbs; images use an index into the list's images and their size.
+    struct DisplayItem {
+        kind: DisplayItemKind,
+        m11: f64,
+        m12: f64,
+        m21: f64,
+        m22: f64,
+        dx: f64,
+        dy: f64,
+        clip: usize,
+        fill_argb: u32,
+        stroke_argb: u32,
+        stroke_width: f64,
+        stroke_cap: u8,
+        stroke_join: u8,
+        miter_limit: f64,
+        even_odd: bool,
+        font_id: u64,
+        font_size: f64,
+        start: usize,
+        count: usize,
+        point_start: usize,
+        width: f64,
+        height: f64,
+    }
+
+    struct DisplayPath {
+        verb_start: usize,
+        verb_count: usize,
+        point_start: usize,
+    }
+
+    struct DisplayFont {
+        id: u64,
+        data: Vec<u8>,
+    }
+
+    struct DisplayImage {
+        data: Vec<u8>,
+    }
+
+    /// A page as a flat list of vector drawing operations, in points.
+    struct DisplayList {
+        complete: bool,
+        width_pts: f64,
+        height_pts: f64,
+        background_argb: u32,
+        items: Vec<DisplayItem>,
+        clips: Vec<DisplayPath>,
+        fonts: Vec<DisplayFont>,
+        images: Vec<DisplayImage>,
+        glyph_ids: Vec<u16>,
+        // Position of each glyph within its run, as x and y pairs
+        glyph_positions: Vec<f64>,
+        path_verbs: Vec<u8>,
+        path_points: Vec<f64>,
+    }
+
     struct PreviewPosition {
         page: usize,
         x_pts: f64,
@@ -161,11 +249,17 @@ pub(crate) mod ffi {
 
         fn set_source(&mut self, text: &str);
 
-        fn apply_content_edit(&mut self, from_utf16_idx: usize, to_utf16_idx: usize, text: &str);
+        fn set_file_source(&mut self, path: &str, text: &str);
+
+        fn apply_content_edits(&mut self, path: &str, edits: &[ContentEdit], text: &str);
+
+        fn close_file(&mut self, path: &str);
 
         fn compile(&mut self, now: &str) -> Vec<PreviewPageDataInternal>;
 
-        fn render_page(&self, page: usize, point_size: f64) -> Result<RenderedPage>;
+        fn take_compile_stats(&mut self) -> CompileStats;
+
+        fn render_snapshot(&self) -> Result<Box<RenderSnapshot>>;
 
         fn export_pdf(
             &self,
@@ -200,6 +294,8 @@ pub(crate) mod ffi {
 
         fn set_compiler_flags(&mut self, a11y_extras: bool);
 
+        fn set_cache_policy(&mut self, max_age: usize, memory_budget_mb: u64);
+
         fn set_allowed_paths(&mut self, paths: Vec<String>);
 
         fn discard_lookup_caches(&mut self);
@@ -214,6 +310,37 @@ pub(crate) mod ffi {
 
         fn get_all_symbols_json() -> Result<String>;
     }
+
+    extern "Rust" {
+        type RenderSnapshot;
+
+        fn render_page(
+            &self,
+            page: usize,
+            point_size: f64,
+            invert_colors: bool,
+        ) -> Result<RenderedPage>;
+
+        fn render_tile(
+            &self,
+            page: usize,
+            point_size: f64,
+            x_px: u32,
+            y_px: u32,
+            width_px: u32,
+            height_px: u32,
+            invert_colors: bool,
+        ) -> Result<RenderedPage>;
+
+        fn display_list(
+            &self,
+            page: usize,
+            known_fonts: &[u64],
+            invert_colors: bool,
+        ) -> Result<DisplayList>;
+
+        fn invert_lightness(buffer: &mut [u8]);
+    }
 }
 
 unsafe impl Send for ffi::PackageManagerProxy {}
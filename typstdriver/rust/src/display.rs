@@ -0,0 +1,548 @@
+/*
+ * This file is part of Katvan
+ * Copyright (c) 2024 - 2026 Igor Khanin
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+use std::hash::{DefaultHasher, Hash, Hasher};
+
+use typst::layout::{Abs, Frame, FrameItem, GroupItem, Point, Size, Transform};
+use typst::text::{Font, Glyph, TextItem};
+use typst::visualize::{
+    Color, Curve, CurveItem, FillRule, Geometry, Image, ImageKind, LineCap, LineJoin, Paint,
+    RasterFormat, Shape,
+};
+use typst_layout::Page;
+
+use crate::bridge::ffi;
+
+pub const VERB_MOVE: u8 = 0;
+pub const VERB_LINE: u8 = 1;
+pub const VERB_CUBIC: u8 = 2;
+pub const VERB_CLOSE: u8 = 3;
+
+/// Flatten a page's frame tree into a display list. Anything the list cannot
+/// represent faithfully (gradient and tiling paints, dashed strokes, stroked
+/// text, vector and pixel-encoded images, fonts from collections, fonts with
+/// bitmap or color glyphs and nested clips) marks it as incomplete, so the
+/// caller can fall back to rasterizing the page instead.
+pub fn build_display_list(
+    page: &Page,
+    known_fonts: &[u64],
+    invert_colors: bool,
+) -> ffi::DisplayList {
+    build_frame_display_list(
+        &page.frame,
+        page.fill_or_white(),
+        known_fonts,
+        invert_colors,
+    )
+}
+
+fn build_frame_display_list(
+    frame: &Frame,
+    fill: Option<Paint>,
+    known_fonts: &[u64],
+    invert_colors: bool,
+) -> ffi::DisplayList {
+    let mut builder = Builder::new(frame.size(), known_fonts, invert_colors);
+    if let Some(fill) = fill {
+        builder.list.background_argb = builder.paint_argb(&fill);
+    }
+    builder.frame(frame, Transform::identity(), 0);
+    builder.list
+}
+
+struct Builder<'a> {
+    known_fonts: &'a [u64],
+    invert_colors: bool,
+    list: ffi::DisplayList,
+}
+
+impl<'a> Builder<'a> {
+    fn new(size: Size, known_fonts: &'a [u64], invert_colors: bool) -> Self {
+        Self {
+            known_fonts,
+            invert_colors,
+            list: ffi::DisplayList {
+                complete: true,
+                width_pts: size.x.to_pt(),
+                height_pts: size.y.to_pt(),
+                background_argb: 0,
+                items: Vec::new(),
+                clips: Vec::new(),
+                fonts: Vec::new(),
+                images: Vec::new(),
+                glyph_ids: Vec::new(),
+                glyph_positions: Vec::new(),
+                path_verbs: Vec::new(),
+                path_points: Vec::new(),
+            },
+        }
+    }
+
+    fn frame(&mut self, frame: &Frame, ts: Transform, clip: usize) {
+        for (pos, item) in frame.items() {
+            let ts = ts.pre_concat(Transform::translate(pos.x, pos.y));
+            match item {
+                FrameItem::Group(group) => self.group(group, ts, clip),
+                FrameItem::Text(text) => self.text(text, ts, clip),
+                FrameItem::Shape(shape, _) => self.shape(shape, ts, clip),
+                FrameItem::Image(image, size, _) => self.image(image, *size, ts, clip),
+                _ => {}
+            }
+        }
+    }
+
+    fn group(&mut self, group: &GroupItem, ts: Transform, clip: usize) {
+        let ts = ts.pre_concat(group.transform);
+
+        let mut clip = clip;
+        if let Some(curve) = &group.clip {
+            if clip != 0 {
+                self.list.complete = false;
+            }
+
+            let verb_start = self.list.path_verbs.len();
+            let point_start = self.list.path_points.len();
+            self.push_curve(curve, ts);
+
+            self.list.clips.push(ffi::DisplayPath {
+                verb_start,
+                verb_count: self.list.path_verbs.len() - verb_start,
+                point_start,
+            });
+            clip = self.list.clips.len();
+        }
+
+        self.frame(&group.frame, ts, clip);
+    }
+
+    fn text(&mut self, text: &TextItem, ts: Transform, clip: usize) {
+        if text.stroke.is_some() {
+            self.list.complete = false;
+        }
+
+        let mut item = self.item(ffi::DisplayItemKind::Glyphs, ts, clip);
+        item.fill_argb = self.paint_argb(&text.fill);
+        item.font_id = self.font(&text.font);
+        item.font_size = text.size.to_pt();
+        item.start = self.list.glyph_ids.len();
+        item.count = text.glyphs.len();
+        self.push_glyphs(&text.glyphs, text.size);
+
+        self.list.items.push(item);
+    }
+
+    fn push_glyphs(&mut self, glyphs: &[Glyph], size: Abs) {
+        // Vertical offsets and advances point up, as in the font, while the
+        // list's y axis points down like the page's
+        let mut pen = Point::zero();
+        for glyph in glyphs {
+            self.list.glyph_ids.push(glyph.id);
+            self.list
+                .glyph_positions
+                .push((pen.x + glyph.x_offset.at(size)).to_pt());
+            self.list
+                .glyph_positions
+                .push(-(pen.y + glyph.y_offset.at(size)).to_pt());
+
+            pen.x += glyph.x_advance.at(size);
+            pen.y += glyph.y_advance.at(size);
+        }
+    }
+
+    fn shape(&mut self, shape: &Shape, ts: Transform, clip: usize) {
+        let mut item = self.item(ffi::DisplayItemKind::Path, ts, clip);
+        item.start = self.list.path_verbs.len();
+        item.point_start = self.list.path_points.len();
+
+        match &shape.geometry {
+            Geometry::Line(to) => {
+                self.push_verb(VERB_MOVE, &[Point::zero()]);
+                self.push_verb(VERB_LINE, &[*to]);
+            }
+            Geometry::Rect(size) => {
+                self.push_verb(VERB_MOVE, &[Point::zero()]);
+                self.push_verb(VERB_LINE, &[Point::with_x(size.x)]);
+                self.push_verb(VERB_LINE, &[size.to_point()]);
+                self.push_verb(VERB_LINE, &[Point::with_y(size.y)]);
+                self.push_verb(VERB_CLOSE, &[]);
+            }
+            Geometry::Curve(curve) => self.push_curve(curve, Transform::identity()),
+        }
+        item.count = self.list.path_verbs.len() - item.start;
+
+        if let Some(fill) = &shape.fill {
+            item.fill_argb = self.paint_argb(fill);
+        }
+        item.even_odd = matches!(shape.fill_rule, FillRule::EvenOdd);
+
+        if let Some(stroke) = &shape.stroke {
+            if stroke.dash.is_some() {
+                self.list.complete = false;
+            }
+            item.stroke_argb = self.paint_argb(&stroke.paint);
+            item.stroke_width = stroke.thickness.to_pt();
+            item.stroke_cap = match stroke.cap {
+                LineCap::Butt => 0,
+                LineCap::Round => 1,
+                LineCap::Square => 2,
+            };
+            item.stroke_join = match stroke.join {
+                LineJoin::Miter => 0,
+                LineJoin::Round => 1,
+                LineJoin::Bevel => 2,
+            };
+            item.miter_limit = stroke.miter_limit.get();
+        }
+
+        self.list.items.push(item);
+    }
+
+    fn image(&mut self, image: &Image, size: Size, ts: Transform, clip: usize) {
+        let ImageKind::Raster(raster) = image.kind() else {
+            self.list.complete = false;
+            return;
+        };
+        if !matches!(raster.format(), RasterFormat::Exchange(_)) {
+            self.list.complete = false;
+            return;
+        }
+
+        let mut item = self.item(ffi::DisplayItemKind::Image, ts, clip);
+        item.start = self.list.images.len();
+        item.count = 1;
+        item.width = size.x.to_pt();
+        item.height = size.y.to_pt();
+
+        self.list.images.push(ffi::DisplayImage {
+            data: raster.data().to_vec(),
+        });
+        self.list.items.push(item);
+    }
+
+    fn item(&self, kind: ffi::DisplayItemKind, ts: Transform, clip: usize) -> ffi::DisplayItem {
+        ffi::DisplayItem {
+            kind,
+            m11: ts.sx.get(),
+            m12: ts.ky.get(),
+            m21: ts.kx.get(),
+            m22: ts.sy.get(),
+            dx: ts.tx.to_pt(),
+            dy: ts.ty.to_pt(),
+            clip,
+            fill_argb: 0,
+            stroke_argb: 0,
+            stroke_width: 0.0,
+            stroke_cap: 0,
+            stroke_join: 0,
+            miter_limit: 0.0,
+            even_odd: false,
+            font_id: 0,
+            font_size: 0.0,
+            start: 0,
+            count: 0,
+            point_start: 0,
+            width: 0.0,
+            height: 0.0,
+        }
+    }
+
+    /// Reference a font by a hash of its data and collection index, sending
+    /// its data along the first time it is seen.
+    fn font(&mut self, font: &Font) -> u64 {
+        // The receiving side only loads the first face of the font's data
+        if font.index() != 0 {
+            self.list.complete = false;
+        }
+
+        // Glyphs are drawn from their outlines, so bitmap, SVG and color
+        // glyphs are left to the rasterizer
+        let tables = font.ttf().tables();
+        if tables.cbdt.is_some()
+            || tables.sbix.is_some()
+            || tables.svg.is_some()
+            || tables.colr.is_some()
+        {
+            self.list.complete = false;
+        }
+
+        let mut hasher = DefaultHasher::new();
+        font.hash(&mut hasher);
+        let id = hasher.finish();
+
+        if !self.known_fonts.contains(&id) && !self.list.fonts.iter().any(|f| f.id == id) {
+            self.list.fonts.push(ffi::DisplayFont {
+                id,
+                data: font.data().to_vec(),
+            });
+        }
+        id
+    }
+
+    fn paint_argb(&mut self, paint: &Paint) -> u32 {
+        let color = match paint {
+            Paint::Solid(color) => *color,
+            _ => {
+                self.list.complete = false;
+                Color::BLACK
+            }
+        };
+
+        let mut rgba = color.to_vec4_u8();
+        if self.invert_colors {
+            rgba = invert_rgba(rgba);
+        }
+
+        let [r, g, b, a] = rgba.map(u32::from);
+        (a << 24) | (r << 16) | (g << 8) | b
+    }
+
+    fn push_curve(&mut self, curve: &Curve, ts: Transform) {
+        for item in curve.0.iter() {
+            match *item {
+                CurveItem::Move(p) => self.push_verb(VERB_MOVE, &[p.transform(ts)]),
+                CurveItem::Line(p) => self.push_verb(VERB_LINE, &[p.transform(ts)]),
+                CurveItem::Cubic(p1, p2, p3) => self.push_verb(
+                    VERB_CUBIC,
+                    &[p1.transform(ts), p2.transform(ts), p3.transform(ts)],
+                ),
+                CurveItem::Close => self.push_verb(VERB_CLOSE, &[]),
+            }
+        }
+    }
+
+    fn push_verb(&mut self, verb: u8, points: &[Point]) {
+        self.list.path_verbs.push(verb);
+        for p in points {
+            self.list.path_points.push(p.x.to_pt());
+            self.list.path_points.push(p.y.to_pt());
+        }
+    }
+}
+
+/// Lightness inversion of a single non-premultiplied color, matching what
+/// `invert_lightness` does to rendered pixels.
+fn invert_rgba([r, g, b, a]: [u8; 4]) -> [u8; 4] {
+    let max = r.max(g).max(b) as i32;
+    let min = r.min(g).min(b) as i32;
+    let shift = |c: u8| (c as i32 + 255 - max - min) as u8;
+    [shift(r), shift(g), shift(b), a]
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    use typst::layout::{Em, Ratio};
+    use typst::syntax::Span;
+    use typst::visualize::{DashPattern, FixedStroke};
+    use typst_kit::fonts::FontStore;
+
+    fn size(width: f64, height: f64) -> Size {
+        Size::new(Abs::pt(width), Abs::pt(height))
+    }
+
+    fn point(x: f64, y: f64) -> Point {
+        Point::new(Abs::pt(x), Abs::pt(y))
+    }
+
+    fn rect(width: f64, height: f64) -> FrameItem {
+        FrameItem::Shape(
+            Geometry::Rect(size(width, height)).filled(Color::BLACK),
+            Span::detached(),
+        )
+    }
+
+    #[test]
+    fn test_background() {
+        let frame = Frame::hard(size(100.0, 200.0));
+
+        let list = build_frame_display_list(&frame, Some(Color::WHITE.into()), &[], false);
+        assert!(list.complete);
+        assert_eq!(list.width_pts, 100.0);
+        assert_eq!(list.height_pts, 200.0);
+        assert_eq!(list.background_argb, 0xffffffff);
+        assert!(list.items.is_empty());
+
+        let list = build_frame_display_list(&frame, Some(Color::WHITE.into()), &[], true);
+        assert_eq!(list.background_argb, 0xff000000);
+
+        let list = build_frame_display_list(&frame, None, &[], false);
+        assert_eq!(list.background_argb, 0);
+    }
+
+    #[test]
+    fn test_transforms() {
+        let mut inner = Frame::soft(size(10.0, 10.0));
+        inner.push(point(1.0, 1.0), rect(5.0, 5.0));
+        inner.transform(Transform::scale(Ratio::new(2.0), Ratio::new(2.0)));
+
+        let mut frame = Frame::hard(size(100.0, 100.0));
+        frame.push(point(3.0, 4.0), rect(5.0, 5.0));
+        frame.push_frame(point(10.0, 20.0), inner);
+
+        let list = build_frame_display_list(&frame, None, &[], false);
+        assert!(list.complete);
+        assert_eq!(list.items.len(), 2);
+
+        let plain = &list.items[0];
+        assert!(plain.kind == ffi::DisplayItemKind::Path);
+        assert_eq!(
+            (plain.m11, plain.m12, plain.m21, plain.m22),
+            (1.0, 0.0, 0.0, 1.0)
+        );
+        assert_eq!((plain.dx, plain.dy), (3.0, 4.0));
+
+        // The group's position applies first, then its transform to the
+        // position of the item within it
+        let scaled = &list.items[1];
+        assert_eq!(
+            (scaled.m11, scaled.m12, scaled.m21, scaled.m22),
+            (2.0, 0.0, 0.0, 2.0)
+        );
+        assert_eq!((scaled.dx, scaled.dy), (12.0, 22.0));
+
+        // Paths of shapes are in item coordinates
+        assert_eq!(list.path_verbs.len(), 10);
+        assert_eq!(&list.path_points[8..10], &[0.0, 0.0]);
+        assert_eq!(&list.path_points[12..14], &[5.0, 5.0]);
+    }
+
+    #[test]
+    fn test_clips() {
+        let mut clipped = Frame::soft(size(10.0, 10.0));
+        clipped.push(Point::zero(), rect(20.0, 20.0));
+        clipped.clip(Curve::rect(size(10.0, 10.0)));
+
+        let mut frame = Frame::hard(size(100.0, 100.0));
+        frame.push(Point::zero(), rect(5.0, 5.0));
+        frame.push_frame(point(5.0, 5.0), clipped);
+        frame.push(point(50.0, 50.0), rect(5.0, 5.0));
+
+        let list = build_frame_display_list(&frame, None, &[], false);
+        assert!(list.complete);
+        assert_eq!(list.items.len(), 3);
+        assert_eq!(list.items[0].clip, 0);
+        assert_eq!(list.items[1].clip, 1);
+        assert_eq!(list.items[2].clip, 0);
+
+        // Clip paths are in page coordinates
+        assert_eq!(list.clips.len(), 1);
+        let clip = &list.clips[0];
+        assert_eq!(list.path_verbs[clip.verb_start], VERB_MOVE);
+        assert_eq!(
+            &list.path_points[clip.point_start..clip.point_start + 2],
+            &[5.0, 5.0]
+        );
+    }
+
+    #[test]
+    fn test_nested_clips_incomplete() {
+        let mut innermost = Frame::soft(size(10.0, 10.0));
+        innermost.push(Point::zero(), rect(10.0, 10.0));
+        innermost.clip(Curve::rect(size(5.0, 5.0)));
+
+        let mut inner = Frame::soft(size(10.0, 10.0));
+        inner.push_frame(Point::zero(), innermost);
+        inner.clip(Curve::rect(size(8.0, 8.0)));
+
+        let mut frame = Frame::hard(size(100.0, 100.0));
+        frame.push_frame(Point::zero(), inner);
+
+        let list = build_frame_display_list(&frame, None, &[], false);
+        assert!(!list.complete);
+    }
+
+    #[test]
+    fn test_dashed_stroke_incomplete() {
+        let mut stroke = FixedStroke::from_pair(Color::BLACK, Abs::pt(1.0));
+        stroke.dash = Some(DashPattern {
+            array: vec![Abs::pt(2.0), Abs::pt(1.0)],
+            phase: Abs::zero(),
+        });
+
+        let mut frame = Frame::hard(size(100.0, 100.0));
+        frame.push(
+            Point::zero(),
+            FrameItem::Shape(
+                Geometry::Line(point(50.0, 0.0)).stroked(stroke),
+                Span::detached(),
+            ),
+        );
+
+        let list = build_frame_display_list(&frame, None, &[], false);
+        assert!(!list.complete);
+    }
+
+    #[test]
+    fn test_glyph_positions() {
+        let glyph = |x_advance: f64, x_offset: f64, y_advance: f64, y_offset: f64| Glyph {
+            id: 1,
+            x_advance: Em::new(x_advance),
+            x_offset: Em::new(x_offset),
+            y_advance: Em::new(y_advance),
+            y_offset: Em::new(y_offset),
+            range: 0..1,
+            span: (Span::detached(), 0),
+        };
+
+        let mut builder = Builder::new(Size::zero(), &[], false);
+        builder.push_glyphs(
+            &[
+                glyph(0.5, 0.0, 0.0, 0.0),
+                // A mark placed above the previous glyph
+                glyph(0.0, -0.25, 0.0, 0.5),
+                glyph(0.5, 0.1, 0.2, -0.1),
+                glyph(0.5, 0.0, 0.0, 0.0),
+            ],
+            Abs::pt(10.0),
+        );
+
+        assert_eq!(builder.list.glyph_ids, vec![1, 1, 1, 1]);
+        assert_eq!(
+            builder.list.glyph_positions,
+            vec![0.0, 0.0, 2.5, -5.0, 6.0, 1.0, 10.0, -2.0]
+        );
+    }
+
+    #[test]
+    fn test_font_dedup() {
+        let mut fonts = FontStore::new();
+        fonts.extend(typst_kit::fonts::embedded());
+        let font = fonts.font(0).expect("Embedded fonts available");
+
+        let mut builder = Builder::new(Size::zero(), &[], false);
+        let id = builder.font(&font);
+        assert_eq!(builder.font(&font), id);
+        assert_eq!(builder.list.fonts.len(), 1);
+        assert_eq!(builder.list.fonts[0].id, id);
+        assert_eq!(builder.list.fonts[0].data, font.data().to_vec());
+
+        // Fonts already sent with earlier lists are referenced by ID only
+        let known_fonts = [id];
+        let mut builder = Builder::new(Size::zero(), &known_fonts, false);
+        assert_eq!(builder.font(&font), id);
+        assert!(builder.list.fonts.is_empty());
+        assert!(builder.list.complete);
+    }
+
+    #[test]
+    fn test_invert_rgba() {
+        assert_eq!(invert_rgba([255, 255, 255, 255]), [0, 0, 0, 255]);
+        assert_eq!(invert_rgba([0, 0, 0, 128]), [255, 255, 255, 128]);
+        assert_eq!(invert_rgba([64, 128, 192, 255]), [63, 127, 191, 255]);
+    }
+}
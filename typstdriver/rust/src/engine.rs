@@ -17,16 +17,24 @@
  */
 use std::hash::{DefaultHasher, Hash, Hasher};
 use std::pin::Pin;
+use std::sync::Arc;
+use std::time::{Duration, Instant};
 
 use anyhow::{Context, Result};
-use typst::layout::{Abs, Point};
+use rayon::prelude::*;
+use typst::layout::{Abs, Frame, FrameItem, Point, Size, Transform};
+use typst::text::{Font, Glyph};
+use typst::visualize::{Curve, CurveItem, Geometry};
 use typst::{World, WorldExt};
 use typst_layout::PagedDocument;
 
 use crate::analysis;
 use crate::bridge::ffi;
+use crate::display;
 use crate::world::KatvanWorld;
 
+const DEFAULT_CACHE_MAX_AGE: usize = 3;
+
 #[derive(Debug)]
 struct DiagnosticFileLocation {
     line: i64,
@@ -90,10 +98,302 @@ impl DiagnosticsLogger for ffi::LoggerProxy {
     }
 }
 
+/// A shared reference to a compiled document, for rendering its pages on
+/// other threads while the engine goes on compiling and answering queries.
+pub struct RenderSnapshot {
+    document: Arc<PagedDocument>,
+}
+
+impl RenderSnapshot {
+    pub fn render_page(
+        &self,
+        page: usize,
+        point_size: f64,
+        invert_colors: bool,
+    ) -> Result<ffi::RenderedPage> {
+        let page = self.document.pages().get(page).context("No such page")?;
+
+        let opts = typst_render::RenderOptions {
+            pixel_per_pt: point_size.into(),
+            ..Default::default()
+        };
+        let pixmap = typst_render::render(page, &opts);
+
+        let width_px = pixmap.width();
+        let height_px = pixmap.height();
+
+        let mut buffer = pixmap.take();
+        if invert_colors {
+            invert_lightness(&mut buffer);
+        }
+
+        Ok(ffi::RenderedPage {
+            width_px,
+            height_px,
+            buffer,
+        })
+    }
+
+    /// Render just a rectangle of a page, given in pixels of the full page
+    /// rendered at the same point size. The page's items are moved so the
+    /// rectangle's corner is at the origin, and items entirely outside of it
+    /// are dropped instead of being rasterized and clipped, down to the
+    /// items within groups.
+    pub fn render_tile(
+        &self,
+        page: usize,
+        point_size: f64,
+        x_px: u32,
+        y_px: u32,
+        width_px: u32,
+        height_px: u32,
+        invert_colors: bool,
+    ) -> Result<ffi::RenderedPage> {
+        let page = self.document.pages().get(page).context("No such page")?;
+
+        let origin = Point::new(
+            Abs::pt(x_px as f64 / point_size),
+            Abs::pt(y_px as f64 / point_size),
+        );
+        let size = Size::new(
+            Abs::pt(width_px as f64 / point_size),
+            Abs::pt(height_px as f64 / point_size),
+        );
+        let end = origin + size.to_point();
+
+        let mut frame = cull_frame(&page.frame, Transform::identity(), origin, end);
+        frame.translate(-origin);
+        frame.set_size(size);
+
+        let mut tile = page.clone();
+        tile.frame = frame;
+
+        let opts = typst_render::RenderOptions {
+            pixel_per_pt: point_size.into(),
+            ..Default::default()
+        };
+        let pixmap = typst_render::render(&tile, &opts);
+
+        // The size in points is rounded up to whole pixels when rendering,
+        // which can add a row or column past the requested rectangle
+        let stride_px = pixmap.width();
+        let width_px = width_px.min(stride_px);
+        let height_px = height_px.min(pixmap.height());
+
+        let mut buffer = crop_buffer(pixmap.take(), stride_px, width_px, height_px);
+        if invert_colors {
+            invert_lightness(&mut buffer);
+        }
+
+        Ok(ffi::RenderedPage {
+            width_px,
+            height_px,
+            buffer,
+        })
+    }
+
+    /// Export a page as a display list for the previewer to draw as vectors.
+    /// Fonts whose IDs are in `known_fonts` were already sent, and only their
+    /// IDs are referenced.
+    pub fn display_list(
+        &self,
+        page: usize,
+        known_fonts: &[u64],
+        invert_colors: bool,
+    ) -> Result<ffi::DisplayList> {
+        let page = self.document.pages().get(page).context("No such page")?;
+        Ok(display::build_display_list(
+            page,
+            known_fonts,
+            invert_colors,
+        ))
+    }
+}
+
+/// Invert the lightness of a premultiplied RGBA buffer in place, keeping
+/// the hue and saturation of every color, for dark mode previews.
+///
+/// Inverting HSL lightness keeps the chroma (max - min) of a color, so every
+/// channel moves by the same amount: `c' = c + 1 - max - min`, where with
+/// premultiplied alpha the 1 is the pixel's alpha. The result never leaves
+/// the channel range, so this needs no clamping or branches, and with the
+/// pixel handled as a single word, the compiler vectorizes the loop.
+pub fn invert_lightness(buffer: &mut [u8]) {
+    for pixel in buffer.chunks_exact_mut(4) {
+        let p = u32::from_le_bytes([pixel[0], pixel[1], pixel[2], pixel[3]]);
+        let r = p & 0xff;
+        let g = (p >> 8) & 0xff;
+        let b = (p >> 16) & 0xff;
+        let a = p >> 24;
+
+        let shift = a
+            .wrapping_sub(r.max(g).max(b))
+            .wrapping_sub(r.min(g).min(b));
+        let result = r.wrapping_add(shift)
+            | (g.wrapping_add(shift) << 8)
+            | (b.wrapping_add(shift) << 16)
+            | (a << 24);
+
+        pixel.copy_from_slice(&result.to_le_bytes());
+    }
+}
+
+/// Copy a frame, keeping only the items that might draw anything inside the
+/// rectangle between `start` and `end`, given in page coordinates. `ts` maps
+/// the frame's coordinates to the page's. Groups are culled item by item,
+/// and entirely if their clip lies outside of the rectangle.
+fn cull_frame(frame: &Frame, ts: Transform, start: Point, end: Point) -> Frame {
+    let mut culled = frame.clone();
+    culled.clear();
+
+    for (pos, item) in frame.items() {
+        let ts = ts.pre_concat(Transform::translate(pos.x, pos.y));
+        if let FrameItem::Group(group) = item {
+            let ts = ts.pre_concat(group.transform);
+            if let Some(clip) = &group.clip
+                && !curve_may_intersect(clip, ts, start, end)
+            {
+                continue;
+            }
+
+            let inner = cull_frame(&group.frame, ts, start, end);
+            if inner.is_empty() {
+                continue;
+            }
+
+            let mut group = group.clone();
+            group.frame = inner;
+            culled.push(*pos, FrameItem::Group(group));
+        } else if item_may_intersect(item, ts, start, end) {
+            culled.push(*pos, item.clone());
+        }
+    }
+    culled
+}
+
+/// Conservatively check if a frame item might draw anything inside the
+/// rectangle between `start` and `end`, where `ts` maps the item's
+/// coordinates to those of the rectangle. Text, images and shapes are
+/// bounded; anything else is always kept.
+fn item_may_intersect(item: &FrameItem, ts: Transform, start: Point, end: Point) -> bool {
+    let (item_start, item_end) = match item {
+        FrameItem::Text(text) => text_bounds(&text.font, text.size, &text.glyphs),
+        FrameItem::Image(_, size, _) => (Point::zero(), size.to_point()),
+        FrameItem::Shape(shape, _) => {
+            let (shape_start, shape_end) = match &shape.geometry {
+                Geometry::Line(to) => bounds([Point::zero(), *to]),
+                Geometry::Rect(size) => (Point::zero(), size.to_point()),
+                Geometry::Curve(curve) => bounds(curve_points(curve)),
+            };
+
+            // Miter joins can stick out well past half of the stroke's width
+            let margin = shape.stroke.as_ref().map_or(Abs::zero(), |stroke| {
+                stroke.thickness * stroke.miter_limit.get().max(1.0)
+            });
+            (
+                shape_start - Point::splat(margin),
+                shape_end + Point::splat(margin),
+            )
+        }
+        _ => return true,
+    };
+
+    let corners = [
+        item_start,
+        Point::new(item_end.x, item_start.y),
+        item_end,
+        Point::new(item_start.x, item_end.y),
+    ];
+    rect_intersects(bounds(corners.map(|p| p.transform(ts))), (start, end))
+}
+
+/// Conservative bounds of a run of glyphs, relative to the start of its
+/// baseline: the font's global bounding box placed at every glyph. Large
+/// operators, stacked marks and swashes can reach well past an em from the
+/// baseline, but never past that box. At least a full em around each glyph
+/// is included, in case the font's bounding box is broken.
+fn text_bounds(font: &Font, size: Abs, glyphs: &[Glyph]) -> (Point, Point) {
+    let bbox = font.ttf().global_bounding_box();
+    let at = |units: i16| font.to_em(units).at(size);
+
+    // The font's y axis points up, the page's down
+    let glyph_start = Point::new(at(bbox.x_min).min(-size), (-at(bbox.y_max)).min(-size));
+    let glyph_end = Point::new(at(bbox.x_max).max(size), (-at(bbox.y_min)).max(size));
+
+    let (mut start, mut end) = bounds([]);
+    let mut pen = Point::zero();
+    for glyph in glyphs {
+        let origin = Point::new(
+            pen.x + glyph.x_offset.at(size),
+            -(pen.y + glyph.y_offset.at(size)),
+        );
+        start = start.min(origin + glyph_start);
+        end = end.max(origin + glyph_end);
+
+        pen.x += glyph.x_advance.at(size);
+        pen.y += glyph.y_advance.at(size);
+    }
+    (start, end)
+}
+
+/// Check if a clip curve, mapped to page coordinates by `ts`, might leave
+/// anything inside the rectangle between `start` and `end` visible.
+fn curve_may_intersect(curve: &Curve, ts: Transform, start: Point, end: Point) -> bool {
+    // The control points of a curve contain it, also once transformed
+    let points = curve_points(curve).map(|p| p.transform(ts));
+    rect_intersects(bounds(points), (start, end))
+}
+
+fn curve_points(curve: &Curve) -> impl Iterator<Item = Point> + '_ {
+    curve
+        .0
+        .iter()
+        .flat_map(|item| match *item {
+            CurveItem::Move(p) | CurveItem::Line(p) => [Some(p), None, None],
+            CurveItem::Cubic(p1, p2, p3) => [Some(p1), Some(p2), Some(p3)],
+            CurveItem::Close => [None; 3],
+        })
+        .flatten()
+}
+
+/// The bounding box of some points. Without any points, it is an inverted
+/// box that intersects nothing.
+fn bounds(points: impl IntoIterator<Item = Point>) -> (Point, Point) {
+    let inf = Abs::inf();
+    points
+        .into_iter()
+        .fold((Point::splat(inf), Point::splat(-inf)), |(min, max), p| {
+            (min.min(p), max.max(p))
+        })
+}
+
+fn rect_intersects((a_start, a_end): (Point, Point), (b_start, b_end): (Point, Point)) -> bool {
+    a_start.x < b_end.x && a_end.x > b_start.x && a_start.y < b_end.y && a_end.y > b_start.y
+}
+
+/// Crop an RGBA buffer with rows of `stride_px` pixels to the rectangle of
+/// `width_px` by `height_px` pixels at its top left corner.
+fn crop_buffer(mut buffer: Vec<u8>, stride_px: u32, width_px: u32, height_px: u32) -> Vec<u8> {
+    let stride = stride_px as usize * 4;
+    let width = width_px as usize * 4;
+    let height = height_px as usize;
+
+    if width != stride {
+        for row in 1..height {
+            buffer.copy_within(row * stride..row * stride + width, row * width);
+        }
+    }
+    buffer.truncate(width * height);
+    buffer
+}
+
 pub struct EngineImpl<'a> {
     logger: &'a ffi::LoggerProxy,
     world: KatvanWorld<'a>,
-    result: Option<PagedDocument>,
+    result: Option<Arc<PagedDocument>>,
+    stats: ffi::CompileStats,
+    cache_max_age: usize,
+    cache_memory_budget: u64,
 }
 
 impl<'a> EngineImpl<'a> {
@@ -106,42 +406,85 @@ impl<'a> EngineImpl<'a> {
             logger,
             world: KatvanWorld::new(package_manager, root),
             result: None,
+            stats: ffi::CompileStats::default(),
+            cache_max_age: DEFAULT_CACHE_MAX_AGE,
+            cache_memory_budget: 0,
         }
     }
 
     pub fn set_source(&mut self, text: &str) {
+        let start = Instant::now();
         self.world.set_source_text(text);
+        self.record_edits(1, start);
+    }
+
+    pub fn set_file_source(&mut self, path: &str, text: &str) {
+        self.world.set_file_source_text(path, text);
+    }
+
+    /// Apply a batch of edits to the main source (if `path` is empty) or to
+    /// an open file. The inserted text of all edits is concatenated in `text`,
+    /// each edit taking the next `text_len` bytes.
+    pub fn apply_content_edits(&mut self, path: &str, edits: &[ffi::ContentEdit], text: &str) {
+        let start = Instant::now();
+        let count = edits.len();
+
+        let mut remaining = text;
+        let edits = edits.iter().map_while(|edit| {
+            if !remaining.is_char_boundary(edit.text_len) {
+                return None;
+            }
+            let (edit_text, rest) = remaining.split_at(edit.text_len);
+            remaining = rest;
+            Some((edit.from_utf16_idx, edit.to_utf16_idx, edit_text))
+        });
+
+        self.world.apply_edits(path, edits);
+        self.record_edits(count, start);
     }
 
-    pub fn apply_content_edit(&mut self, from_utf16_idx: usize, to_utf16_idx: usize, text: &str) {
-        self.world.apply_edit(from_utf16_idx, to_utf16_idx, text);
+    /// Edits are applied as they arrive, so their cost is accounted to the
+    /// statistics of the next compilation.
+    fn record_edits(&mut self, count: usize, start: Instant) {
+        self.stats.edits += count;
+        self.stats.edits_nsecs += duration_nsecs(start.elapsed());
+    }
+
+    pub fn close_file(&mut self, path: &str) {
+        self.world.close_file(path);
     }
 
     pub fn compile(&mut self, now: &str) -> Vec<ffi::PreviewPageDataInternal> {
         self.world.reset_current_date(now);
+        self.world.reset_file_checks();
 
-        let start = std::time::Instant::now();
+        // Evaluation, layout and introspection iterations all happen inside
+        // typst::compile, and are only measured together.
+        let start = Instant::now();
         let res = typst::compile::<PagedDocument>(&self.world);
+        let typst_time = start.elapsed();
+
+        let (files_cached, files_read) = self.world.file_cache_stats();
+        self.stats.typst_nsecs = duration_nsecs(typst_time);
+        self.stats.files_cached = files_cached;
+        self.stats.files_read = files_read;
 
-        let elapsed = format!("{:.2?}", start.elapsed());
+        let elapsed = format!("{typst_time:.2?}");
         let warnings = res.warnings;
 
         if let Ok(doc) = res.output {
-            self.logger.log_diagnostics(&self.world, &warnings);
-
-            if warnings.is_empty() {
-                self.logger
-                    .log_note(&format!("compiled successfully in {elapsed}"));
-            } else {
-                self.logger
-                    .log_note(&format!("compiled with warnings in {elapsed}"));
-            }
-
-            typst::comemo::evict(3);
-
-            let pages = doc
+            let evict_start = Instant::now();
+            let max_age = self.cache_max_age_for(resident_memory());
+            typst::comemo::evict(max_age);
+            let evict_time = evict_start.elapsed();
+
+            let fingerprint_start = Instant::now();
+            // Frame contents are hashed lazily and the hash cached alongside
+            // them, so pages reused from a previous compilation are cheap here.
+            // New pages have to be hashed in full though, so spread the work.
+            let pages: Vec<_> = doc
                 .pages()
-                .iter()
+                .par_iter()
                 .map(|page| ffi::PreviewPageDataInternal {
                     page_num: page.number,
                     width_pts: page.frame.width().abs().to_pt(),
@@ -149,8 +492,35 @@ impl<'a> EngineImpl<'a> {
                     fingerprint: calc_fingerprint(&(&page.frame, &page.fill)),
                 })
                 .collect();
+            let fingerprint_time = fingerprint_start.elapsed();
+
+            self.stats.success = true;
+            self.stats.pages = pages.len();
+            self.stats.evict_nsecs = duration_nsecs(evict_time);
+            self.stats.cache_max_age = max_age;
+            self.stats.resident_bytes = resident_memory().unwrap_or(0);
+            self.stats.fingerprint_nsecs = duration_nsecs(fingerprint_time);
+
+            let mut breakdown = format!(
+                "page fingerprints {fingerprint_time:.2?}, cache eviction {evict_time:.2?}, \
+                 files {files_cached} cached / {files_read} read"
+            );
+            if max_age < self.cache_max_age {
+                breakdown.push_str(", over cache memory limit");
+            }
 
-            self.result = Some(doc);
+            self.logger.log_diagnostics(&self.world, &warnings);
+
+            if warnings.is_empty() {
+                self.logger
+                    .log_note(&format!("compiled successfully in {elapsed} ({breakdown})"));
+            } else {
+                self.logger.log_note(&format!(
+                    "compiled with warnings in {elapsed} ({breakdown})"
+                ));
+            }
+
+            self.result = Some(Arc::new(doc));
             pages
         } else {
             let errors = res.output.unwrap_err();
@@ -164,21 +534,27 @@ impl<'a> EngineImpl<'a> {
         }
     }
 
-    pub fn render_page(&self, page: usize, point_size: f64) -> Result<ffi::RenderedPage> {
-        let document = self.result.as_ref().context("Invalid state")?;
-        let page = document.pages().get(page).context("No such page")?;
+    /// Memoized results not used by the last `max_age` compilations are
+    /// evicted after each compilation. When over the memory budget, only the
+    /// results of the very last compilation are kept.
+    fn cache_max_age_for(&self, resident_bytes: Option<u64>) -> usize {
+        match resident_bytes {
+            Some(bytes) if self.cache_memory_budget > 0 && bytes > self.cache_memory_budget => 1,
+            _ => self.cache_max_age,
+        }
+    }
 
-        let opts = typst_render::RenderOptions {
-            pixel_per_pt: point_size.into(),
-            ..Default::default()
-        };
-        let pixmap = typst_render::render(page, &opts);
+    /// Statistics of the last compilation, including edits applied before
+    /// it. Taking them starts accounting edits for the next compilation.
+    pub fn take_compile_stats(&mut self) -> ffi::CompileStats {
+        std::mem::take(&mut self.stats)
+    }
 
-        Ok(ffi::RenderedPage {
-            width_px: pixmap.width(),
-            height_px: pixmap.height(),
-            buffer: pixmap.take(),
-        })
+    pub fn render_snapshot(&self) -> Result<Box<RenderSnapshot>> {
+        let document = self.result.as_deref().context("Invalid state")?;
+        Ok(Box::new(RenderSnapshot {
+            document: Arc::clone(document),
+        }))
     }
 
     pub fn export_pdf(
@@ -188,7 +564,7 @@ impl<'a> EngineImpl<'a> {
         pdfa_standard: &str,
         tagged: bool,
     ) -> Result<bool> {
-        let document = self.result.as_ref().context("Invalid state")?;
+        let document = self.result.as_deref().context("Invalid state")?;
         crate::export::export_pdf(
             document,
             &self.world,
@@ -201,12 +577,12 @@ impl<'a> EngineImpl<'a> {
     }
 
     pub fn export_png(&self, path: &str, dpi: u32) -> Result<bool> {
-        let document = self.result.as_ref().context("Invalid state")?;
+        let document = self.result.as_deref().context("Invalid state")?;
         Ok(crate::export::export_png(document, self.logger, path, dpi))
     }
 
     pub fn export_png_multi(&self, dir: &str, name_pattern: &str, dpi: u32) -> Result<bool> {
-        let document = self.result.as_ref().context("Invalid state")?;
+        let document = self.result.as_deref().context("Invalid state")?;
         Ok(crate::export::export_png_multi(
             document,
             self.logger,
@@ -217,7 +593,7 @@ impl<'a> EngineImpl<'a> {
     }
 
     pub fn forward_search(&self, line: usize, column: usize) -> Result<Vec<ffi::PreviewPosition>> {
-        let document = self.result.as_ref().context("Invalid state")?;
+        let document = self.result.as_deref().context("Invalid state")?;
         let main = self.world.main_source();
 
         let cursor = main
@@ -256,7 +632,7 @@ impl<'a> EngineImpl<'a> {
     }
 
     pub fn inverse_search(&self, pos: &ffi::PreviewPosition) -> Result<ffi::SourcePosition> {
-        let document = self.result.as_ref().context("Invalid state")?;
+        let document = self.result.as_deref().context("Invalid state")?;
         let page = std::num::NonZero::new(pos.page + 1).unwrap();
         let point = Point::new(Abs::pt(pos.x_pts), Abs::pt(pos.y_pts));
 
@@ -276,7 +652,7 @@ impl<'a> EngineImpl<'a> {
             .line_column_to_byte(line, column)
             .context("No such position")?;
 
-        analysis::tooltip::get_tooltip(&self.world, self.result.as_ref(), &main, cursor)
+        analysis::tooltip::get_tooltip(&self.world, self.result.as_deref(), &main, cursor)
             .context("No available tooltip")
     }
 
@@ -292,9 +668,14 @@ impl<'a> EngineImpl<'a> {
             .line_column_to_byte(line, column)
             .context("No such position")?;
 
-        let (start_cursor, completions) =
-            typst_ide::autocomplete(&self.world, self.result.as_ref(), &main, cursor, !implicit)
-                .context("No available completions")?;
+        let (start_cursor, completions) = typst_ide::autocomplete(
+            &self.world,
+            self.result.as_deref(),
+            &main,
+            cursor,
+            !implicit,
+        )
+        .context("No available completions")?;
 
         Ok(ffi::Completions {
             from: ffi::SourcePosition {
@@ -312,12 +693,12 @@ impl<'a> EngineImpl<'a> {
             .line_column_to_byte(line, column)
             .context("No such position")?;
 
-        analysis::get_definition(&self.world, self.result.as_ref(), &main, cursor)
+        analysis::get_definition(&self.world, self.result.as_deref(), &main, cursor)
             .context("Definition not found")
     }
 
     pub fn get_metadata(&self) -> Result<ffi::DocumentMetadata> {
-        let doc = self.result.as_ref().context("Invalid state")?;
+        let doc = self.result.as_deref().context("Invalid state")?;
         let main = self.world.main_source();
 
         let (outline, labels) = analysis::get_metadata(doc, &main);
@@ -332,7 +713,7 @@ impl<'a> EngineImpl<'a> {
     }
 
     pub fn count_page_words(&self, page: usize) -> Result<usize> {
-        let doc = self.result.as_ref().context("Invalid state")?;
+        let doc = self.result.as_deref().context("Invalid state")?;
         let page = doc.pages().get(page).context("No such page")?;
 
         Ok(analysis::count_words(&page.frame))
@@ -342,6 +723,11 @@ impl<'a> EngineImpl<'a> {
         self.world.set_compiler_flags(a11y_extras);
     }
 
+    pub fn set_cache_policy(&mut self, max_age: usize, memory_budget_mb: u64) {
+        self.cache_max_age = max_age.max(1);
+        self.cache_memory_budget = memory_budget_mb.saturating_mul(1024 * 1024);
+    }
+
     pub fn set_allowed_paths(&mut self, paths: Vec<String>) {
         self.world.set_allowed_paths(paths);
     }
@@ -413,6 +799,347 @@ fn calc_fingerprint<H: Hash>(item: &H) -> u64 {
     hasher.finish()
 }
 
+/// Resident set size of the process, where the platform makes it cheap to
+/// find out.
+fn resident_memory() -> Option<u64> {
+    if !cfg!(target_os = "linux") {
+        return None;
+    }
+
+    let status = std::fs::read_to_string("/proc/self/status").ok()?;
+    let line = status.lines().find(|line| line.starts_with("VmRSS:"))?;
+    let kb: u64 = line
+        .trim_start_matches("VmRSS:")
+        .trim()
+        .trim_end_matches("kB")
+        .trim()
+        .parse()
+        .ok()?;
+    Some(kb * 1024)
+}
+
+fn duration_nsecs(duration: Duration) -> u64 {
+    u64::try_from(duration.as_nanos()).unwrap_or(u64::MAX)
+}
+
 fn is_in_sandbox() -> bool {
     cfg!(feature = "flatpak")
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    use std::collections::HashMap;
+
+    use typst::layout::{Em, GroupItem, Ratio};
+    use typst::syntax::Span;
+    use typst::visualize::Color;
+    use typst_kit::fonts::FontStore;
+
+    fn point(x: f64, y: f64) -> Point {
+        Point::new(Abs::pt(x), Abs::pt(y))
+    }
+
+    fn size(width: f64, height: f64) -> Size {
+        Size::new(Abs::pt(width), Abs::pt(height))
+    }
+
+    fn rect(width: f64, height: f64) -> FrameItem {
+        FrameItem::Shape(
+            Geometry::Rect(size(width, height)).filled(Color::BLACK),
+            Span::detached(),
+        )
+    }
+
+    fn count_leaf_items(frame: &Frame) -> usize {
+        frame
+            .items()
+            .map(|(_, item)| match item {
+                FrameItem::Group(group) => count_leaf_items(&group.frame),
+                _ => 1,
+            })
+            .sum()
+    }
+
+    fn cull_count(frame: &Frame, start: Point, end: Point) -> usize {
+        count_leaf_items(&cull_frame(frame, Transform::identity(), start, end))
+    }
+
+    #[test]
+    fn test_cull_frame_items() {
+        let mut frame = Frame::hard(size(1000.0, 1000.0));
+        frame.push(point(10.0, 10.0), rect(10.0, 10.0));
+        frame.push(point(500.0, 500.0), rect(10.0, 10.0));
+
+        assert_eq!(cull_count(&frame, point(0.0, 0.0), point(100.0, 100.0)), 1);
+        assert_eq!(
+            cull_count(&frame, point(0.0, 0.0), point(1000.0, 1000.0)),
+            2
+        );
+        assert_eq!(
+            cull_count(&frame, point(200.0, 200.0), point(300.0, 300.0)),
+            0
+        );
+    }
+
+    #[test]
+    fn test_cull_frame_groups() {
+        // Two items in a group, one of which is far from the other
+        let mut inner = Frame::hard(size(1000.0, 1000.0));
+        inner.push(point(0.0, 0.0), rect(10.0, 10.0));
+        inner.push(point(800.0, 800.0), rect(10.0, 10.0));
+
+        let mut frame = Frame::hard(size(2000.0, 2000.0));
+        frame.push(point(100.0, 100.0), FrameItem::Group(GroupItem::new(inner)));
+
+        assert_eq!(cull_count(&frame, point(0.0, 0.0), point(200.0, 200.0)), 1);
+        assert_eq!(
+            cull_count(&frame, point(850.0, 850.0), point(950.0, 950.0)),
+            1
+        );
+        assert_eq!(
+            cull_count(&frame, point(400.0, 400.0), point(500.0, 500.0)),
+            0
+        );
+    }
+
+    fn glyph(x_advance: f64, y_offset: f64) -> Glyph {
+        Glyph {
+            id: 1,
+            x_advance: Em::new(x_advance),
+            x_offset: Em::zero(),
+            y_advance: Em::zero(),
+            y_offset: Em::new(y_offset),
+            range: 0..1,
+            span: (Span::detached(), 0),
+        }
+    }
+
+    #[test]
+    fn test_cull_text() {
+        let mut fonts = FontStore::new();
+        fonts.extend(typst_kit::fonts::embedded());
+
+        let size = Abs::pt(10.0);
+        let glyphs = [glyph(0.5, 0.0), glyph(0.0, 0.5), glyph(0.5, 0.0)];
+
+        let mut tallest = Abs::zero();
+        for font in (0..).map_while(|index| fonts.font(index)) {
+            let bbox = font.ttf().global_bounding_box();
+            let top = font.to_em(bbox.y_max).at(size);
+            let bottom = font.to_em(bbox.y_min).at(size);
+            tallest = tallest.max(top);
+
+            // The raised glyph reaches half an em higher than the others
+            let (start, end) = text_bounds(&font, size, &glyphs);
+            assert!(start.y <= -(top + size * 0.5));
+            assert!(start.y <= -(size * 1.5));
+            assert!(end.y >= -bottom);
+            assert!(end.y >= size);
+            assert!(end.x >= size * 2.0);
+
+            // A tile just above the top of the font's tallest glyphs is
+            // never needed for this run
+            let above = point(0.0, (start.y - Abs::pt(20.0)).to_pt());
+            assert!(!rect_intersects(
+                (start, end),
+                (above, point(100.0, start.y.to_pt()))
+            ));
+            assert!(rect_intersects(
+                (start, end),
+                (above, point(100.0, start.y.to_pt() + 1.0))
+            ));
+        }
+
+        // Math fonts have operators far taller than an em, which a fixed
+        // em of margin used to cut at tile seams
+        assert!(tallest > size * 1.5);
+    }
+
+    #[test]
+    fn test_cull_frame_group_transform() {
+        let mut inner = Frame::hard(size(10.0, 10.0));
+        inner.push(point(15.0, 15.0), rect(1.0, 1.0));
+
+        let mut group = GroupItem::new(inner);
+        group.transform = Transform::scale(Ratio::new(10.0), Ratio::new(10.0));
+
+        let mut frame = Frame::hard(size(1000.0, 1000.0));
+        frame.push(point(0.0, 0.0), FrameItem::Group(group));
+
+        // The rectangle ends up between (150, 150) and (160, 160)
+        assert_eq!(
+            cull_count(&frame, point(100.0, 100.0), point(200.0, 200.0)),
+            1
+        );
+        assert_eq!(cull_count(&frame, point(0.0, 0.0), point(100.0, 100.0)), 0);
+        assert_eq!(
+            cull_count(&frame, point(165.0, 165.0), point(200.0, 200.0)),
+            0
+        );
+    }
+
+    #[test]
+    fn test_cull_frame_group_clip() {
+        let mut inner = Frame::hard(size(10.0, 10.0));
+        inner.push(point(0.0, 0.0), rect(1000.0, 1000.0));
+
+        let mut group = GroupItem::new(inner);
+        group.clip = Some(Curve::rect(size(10.0, 10.0)));
+
+        let mut frame = Frame::hard(size(1000.0, 1000.0));
+        frame.push(point(500.0, 500.0), FrameItem::Group(group));
+
+        // The rectangle itself would reach the tile, but is clipped
+        assert_eq!(
+            cull_count(&frame, point(800.0, 800.0), point(900.0, 900.0)),
+            0
+        );
+        assert_eq!(
+            cull_count(&frame, point(450.0, 450.0), point(550.0, 550.0)),
+            1
+        );
+    }
+
+    #[test]
+    fn test_crop_buffer() {
+        let buffer: Vec<u8> = (0..4 * 3 * 3).collect();
+
+        assert_eq!(crop_buffer(buffer.clone(), 3, 3, 3), buffer);
+        assert_eq!(crop_buffer(buffer.clone(), 3, 3, 2), buffer[..24].to_vec());
+        assert_eq!(
+            crop_buffer(buffer, 3, 2, 2),
+            vec![
+                0, 1, 2, 3, 4, 5, 6, 7, //
+                12, 13, 14, 15, 16, 17, 18, 19, //
+            ]
+        );
+    }
+
+    #[test]
+    fn test_invert_lightness() {
+        let mut buffer = vec![
+            255, 255, 255, 255, // White
+            0, 0, 0, 255, // Black
+            255, 0, 0, 255, // Red, at half lightness
+            64, 128, 192, 255, // Half lightness blue
+            200, 150, 100, 255, // Light orange
+            100, 75, 50, 128, // Premultiplied, same color at half opacity
+            0, 0, 0, 0, // Transparent
+        ];
+        invert_lightness(&mut buffer);
+
+        assert_eq!(
+            buffer,
+            vec![
+                0, 0, 0, 255, //
+                255, 255, 255, 255, //
+                255, 0, 0, 255, //
+                63, 127, 191, 255, //
+                155, 105, 55, 255, //
+                78, 53, 28, 128, //
+                0, 0, 0, 0, //
+            ]
+        );
+    }
+
+    /// Times inverting a full page, against a hash cached HSL round trip like
+    /// the one the previewer used before. Not run by default, as it is only
+    /// meaningful in release builds:
+    /// `cargo test --release -- --ignored --nocapture bench_invert_lightness`
+    #[test]
+    #[ignore]
+    fn bench_invert_lightness() {
+        // A4 at 2x, white with 15% of the pixels antialiased grey
+        const WIDTH: usize = 1587;
+        const HEIGHT: usize = 2245;
+
+        let mut seed: u32 = 1;
+        let mut page = Vec::with_capacity(WIDTH * HEIGHT * 4);
+        for _ in 0..WIDTH * HEIGHT {
+            seed = seed.wrapping_mul(1664525).wrapping_add(1013904223);
+            let v = if seed >> 24 < 38 {
+                (seed >> 16) as u8
+            } else {
+                255
+            };
+            page.extend_from_slice(&[v, v, v, 255]);
+        }
+
+        fn invert_hsl(pixel: u32) -> u32 {
+            let [r, g, b, a] = pixel.to_le_bytes().map(|c| c as f64 / 255.0);
+            let max = r.max(g).max(b);
+            let min = r.min(g).min(b);
+            let d = max - min;
+            let l = (max + min) / 2.0;
+            let (h, s) = if d == 0.0 {
+                (0.0, 0.0)
+            } else if max == r {
+                ((g - b) / d / 6.0, d / (1.0 - (2.0 * l - 1.0).abs()))
+            } else if max == g {
+                (((b - r) / d + 2.0) / 6.0, d / (1.0 - (2.0 * l - 1.0).abs()))
+            } else {
+                (((r - g) / d + 4.0) / 6.0, d / (1.0 - (2.0 * l - 1.0).abs()))
+            };
+
+            let l = 1.0 - l;
+            let q = if l < 0.5 {
+                l * (1.0 + s)
+            } else {
+                l + s - l * s
+            };
+            let p = 2.0 * l - q;
+            let channel = |t: f64| {
+                let t = t.rem_euclid(1.0);
+                let v = if t < 1.0 / 6.0 {
+                    p + (q - p) * 6.0 * t
+                } else if t < 0.5 {
+                    q
+                } else if t < 2.0 / 3.0 {
+                    p + (q - p) * (2.0 / 3.0 - t) * 6.0
+                } else {
+                    p
+                };
+                (v * 255.0).round() as u8
+            };
+            u32::from_le_bytes([
+                channel(h + 1.0 / 3.0),
+                channel(h),
+                channel(h - 1.0 / 3.0),
+                (a * 255.0).round() as u8,
+            ])
+        }
+
+        fn time(page: &[u8], mut invert: impl FnMut(&mut [u8])) -> (Vec<u8>, Duration, Duration) {
+            let mut buffer = page.to_vec();
+            let mut runs: Vec<_> = (0..20)
+                .map(|_| {
+                    buffer.copy_from_slice(page);
+                    let start = Instant::now();
+                    invert(std::hint::black_box(&mut buffer));
+                    start.elapsed()
+                })
+                .collect();
+            runs.sort();
+            (buffer, runs[0], runs[runs.len() / 2])
+        }
+
+        let (fast, fast_min, fast_median) = time(&page, invert_lightness);
+
+        let mut cache = HashMap::new();
+        let (reference, reference_min, reference_median) = time(&page, |buffer| {
+            for pixel in buffer.chunks_exact_mut(4) {
+                let p = u32::from_le_bytes([pixel[0], pixel[1], pixel[2], pixel[3]]);
+                let result = *cache.entry(p).or_insert_with(|| invert_hsl(p));
+                pixel.copy_from_slice(&result.to_le_bytes());
+            }
+        });
+
+        assert_eq!(fast, reference);
+        println!(
+            "{WIDTH}x{HEIGHT} page: invert_lightness {fast_min:.2?} min / {fast_median:.2?} median, \
+             cached HSL round trip {reference_min:.2?} min / {reference_median:.2?} median"
+        );
+    }
+}
@@ -17,6 +17,7 @@
  */
 mod analysis;
 mod bridge;
+mod display;
 mod engine;
 mod export;
 mod util;
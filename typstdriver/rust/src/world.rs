@@ -19,7 +19,11 @@ use std::{
     collections::HashMap,
     path::{Component, Path, PathBuf},
     pin::Pin,
-    sync::Mutex,
+    sync::{
+        Mutex, OnceLock,
+        atomic::{AtomicUsize, Ordering},
+    },
+    time::SystemTime,
 };
 
 use time::{OffsetDateTime, format_description::well_known::Iso8601};
@@ -49,19 +53,13 @@ fn extract_path_prefix(path: &Path) -> PathBuf {
     prefix
 }
 
-pub struct KatvanWorld<'a> {
-    path_mapper: pathmap::PathMapper,
-    package_manager: Mutex<PackageManagerWrapper<'a>>,
-    packages_list: once_cell::sync::OnceCell<Vec<(PackageSpec, Option<EcoString>)>>,
-    library: LazyHash<Library>,
-    fonts: FontStore,
-    source: Source,
-    root_prefix: PathBuf,
-    now: Option<OffsetDateTime>,
-}
+/// Discovering fonts means scanning all installed fonts, which can take
+/// seconds on systems with many of them. Do it only once per process, on
+/// first use, and share the result between all engines.
+fn shared_fonts() -> &'static FontStore {
+    static FONTS: OnceLock<FontStore> = OnceLock::new();
 
-impl<'a> KatvanWorld<'a> {
-    pub fn new(package_manager: Pin<&'a mut ffi::PackageManagerProxy>, root: &str) -> Self {
+    FONTS.get_or_init(|| {
         let font_dirs: Vec<PathBuf> = std::env::var_os("TYPST_FONT_PATHS")
             .map(|p| std::env::split_paths(&p).collect())
             .unwrap_or_default();
@@ -73,7 +71,27 @@ impl<'a> KatvanWorld<'a> {
         for dir in &font_dirs {
             fonts.extend(typst_kit::fonts::scan(dir));
         }
+        fonts
+    })
+}
 
+pub struct KatvanWorld<'a> {
+    path_mapper: pathmap::PathMapper,
+    package_manager: Mutex<PackageManagerWrapper<'a>>,
+    packages_list: once_cell::sync::OnceCell<Vec<(PackageSpec, Option<EcoString>)>>,
+    library: LazyHash<Library>,
+    fonts: &'static FontStore,
+    source: Source,
+    overlays: Overlays,
+    files: Mutex<HashMap<FileId, FileSlot>>,
+    file_hits: AtomicUsize,
+    file_reads: AtomicUsize,
+    root_prefix: PathBuf,
+    now: Option<OffsetDateTime>,
+}
+
+impl<'a> KatvanWorld<'a> {
+    pub fn new(package_manager: Pin<&'a mut ffi::PackageManagerProxy>, root: &str) -> Self {
         // For Typst 0.15 - the new `path` type checks if a path "escapes" the
         // project root before ever consulting the `World` implementation, which
         // prevents use of relative paths that use ".." but are still within the
@@ -94,8 +112,12 @@ impl<'a> KatvanWorld<'a> {
             package_manager: Mutex::new(PackageManagerWrapper::new(package_manager)),
             packages_list: once_cell::sync::OnceCell::new(),
             library: LazyHash::new(Library::default()),
-            fonts,
+            fonts: shared_fonts(),
             source,
+            overlays: Overlays::default(),
+            files: Mutex::new(HashMap::new()),
+            file_hits: AtomicUsize::new(0),
+            file_reads: AtomicUsize::new(0),
             root_prefix,
             now: None,
         }
@@ -105,12 +127,34 @@ impl<'a> KatvanWorld<'a> {
         self.source.replace(text);
     }
 
-    pub fn apply_edit(&mut self, from_utf16_idx: usize, to_utf16_idx: usize, text: &str) {
-        let from = self.source.lines().utf16_to_byte(from_utf16_idx);
-        let to = self.source.lines().utf16_to_byte(to_utf16_idx);
+    /// Set the in-memory content of a file other than the main source, e.g.
+    /// an included chapter open with unsaved changes. It will be used instead
+    /// of the file's content on disk until closed.
+    pub fn set_file_source_text(&mut self, path: &str, text: &str) {
+        if let Some(id) = self.file_id_for_path(path) {
+            self.overlays.set(id, text);
+        }
+    }
 
-        if let (Some(from), Some(to)) = (from, to) {
-            self.source.edit(from..to, text);
+    /// Apply a sequence of edits, in order, to the main source if `path` is
+    /// empty, or otherwise to the in-memory content of the given file.
+    pub fn apply_edits<'t>(
+        &mut self,
+        path: &str,
+        edits: impl IntoIterator<Item = (usize, usize, &'t str)>,
+    ) {
+        if path.is_empty() {
+            for (from_utf16_idx, to_utf16_idx, text) in edits {
+                apply_source_edit(&mut self.source, from_utf16_idx, to_utf16_idx, text);
+            }
+        } else if let Some(id) = self.file_id_for_path(path) {
+            self.overlays.edit(id, edits);
+        }
+    }
+
+    pub fn close_file(&mut self, path: &str) {
+        if let Some(id) = self.file_id_for_path(path) {
+            self.overlays.close(id);
         }
     }
 
@@ -121,6 +165,28 @@ impl<'a> KatvanWorld<'a> {
     pub fn discard_package_roots_cache(&mut self) {
         let mut manager = self.package_manager.lock().unwrap();
         manager.roots_cache.clear();
+
+        self.files.get_mut().unwrap().clear();
+    }
+
+    /// Make the next access to each cached file check whether it changed on
+    /// disk. Should be called before every compilation.
+    pub fn reset_file_checks(&mut self) {
+        for slot in self.files.get_mut().unwrap().values_mut() {
+            slot.checked = false;
+        }
+
+        *self.file_hits.get_mut() = 0;
+        *self.file_reads.get_mut() = 0;
+    }
+
+    /// Number of file accesses served from the cache, and ones that had to
+    /// read the file from disk, since the last call to `reset_file_checks`.
+    pub fn file_cache_stats(&self) -> (usize, usize) {
+        (
+            self.file_hits.load(Ordering::Relaxed),
+            self.file_reads.load(Ordering::Relaxed),
+        )
     }
 
     pub fn set_compiler_flags(&mut self, a11y_extras: bool) {
@@ -138,6 +204,9 @@ impl<'a> KatvanWorld<'a> {
 
     pub fn set_allowed_paths(&mut self, paths: Vec<String>) {
         self.path_mapper.set_allowed_paths(paths);
+
+        // Files may have become accessible or inaccessible
+        self.files.get_mut().unwrap().clear();
     }
 
     pub fn main_source(&self) -> Source {
@@ -149,22 +218,218 @@ impl<'a> KatvanWorld<'a> {
         manager.get_package_root(pkg)
     }
 
-    fn get_file_content(&self, id: FileId) -> FileResult<Vec<u8>> {
-        let path = match id.root() {
+    fn file_id_for_path(&self, path: &str) -> Option<FileId> {
+        let path = VirtualPath::virtualize(&self.root_prefix, Path::new(path)).ok()?;
+        Some(RootedPath::new(VirtualRoot::Project, path).intern())
+    }
+
+    fn get_file_path(&self, id: FileId) -> FileResult<PathBuf> {
+        match id.root() {
             VirtualRoot::Package(pkg) => {
                 let root = self.get_package_root(pkg)?;
-                id.vpath().realize(&root)?
+                Ok(id.vpath().realize(&root)?)
             }
             VirtualRoot::Project => {
                 let path = id.vpath().realize(&self.root_prefix)?;
-                self.path_mapper.get_fs_file_path(&path)?
+                self.path_mapper.get_fs_file_path(&path)
             }
+        }
+    }
+
+    /// Access the cached slot of a file. The lock on the cache is only held
+    /// to take a copy of the slot and to store it back, so that checking,
+    /// reading and parsing the file doesn't block other threads of the
+    /// compilation. Two threads accessing the same file at once may both
+    /// read it, with the same result.
+    fn with_file_slot<T>(&self, id: FileId, f: impl FnOnce(&mut FileSlot) -> T) -> T {
+        let cached = self.files.lock().unwrap().get(&id).cloned();
+        let mut slot = cached.unwrap_or_else(|| FileSlot::new(id));
+
+        if !slot.checked {
+            slot.checked = true;
+            slot.revalidate(self.get_file_path(id));
+        }
+
+        let prev_reads = slot.reads;
+        let result = f(&mut slot);
+
+        if slot.reads > prev_reads {
+            self.file_reads.fetch_add(1, Ordering::Relaxed);
+        } else {
+            self.file_hits.fetch_add(1, Ordering::Relaxed);
+        }
+
+        self.files.lock().unwrap().insert(id, slot);
+        result
+    }
+}
+
+fn apply_source_edit(source: &mut Source, from_utf16_idx: usize, to_utf16_idx: usize, text: &str) {
+    let from = source.lines().utf16_to_byte(from_utf16_idx);
+    let to = source.lines().utf16_to_byte(to_utf16_idx);
+
+    if let (Some(from), Some(to)) = (from, to) {
+        source.edit(from..to, text);
+    }
+}
+
+/// In-memory content of files other than the main source, such as chapters
+/// open with unsaved changes in other windows. Used instead of the content
+/// of the files on disk until closed.
+#[derive(Default)]
+struct Overlays(HashMap<FileId, Source>);
+
+impl Overlays {
+    fn set(&mut self, id: FileId, text: &str) {
+        self.0
+            .entry(id)
+            .and_modify(|source| {
+                source.replace(text);
+            })
+            .or_insert_with(|| Source::new(id, text.to_string()));
+    }
+
+    /// Returns false if the file has no overlay to edit.
+    fn edit<'t>(
+        &mut self,
+        id: FileId,
+        edits: impl IntoIterator<Item = (usize, usize, &'t str)>,
+    ) -> bool {
+        let Some(source) = self.0.get_mut(&id) else {
+            return false;
         };
 
-        if path.is_dir() {
-            return Err(FileError::IsDirectory);
+        for (from_utf16_idx, to_utf16_idx, text) in edits {
+            apply_source_edit(source, from_utf16_idx, to_utf16_idx, text);
+        }
+        true
+    }
+
+    fn close(&mut self, id: FileId) {
+        self.0.remove(&id);
+    }
+
+    fn source(&self, id: FileId, disk: impl FnOnce() -> FileResult<Source>) -> FileResult<Source> {
+        match self.0.get(&id) {
+            Some(source) => Ok(source.clone()),
+            None => disk(),
         }
-        std::fs::read(&path).map_err(|err| FileError::from_io(err, &path))
+    }
+
+    fn bytes(&self, id: FileId, disk: impl FnOnce() -> FileResult<Bytes>) -> FileResult<Bytes> {
+        match self.0.get(&id) {
+            Some(source) => Ok(Bytes::new(source.text().as_bytes().to_vec())),
+            None => disk(),
+        }
+    }
+}
+
+#[derive(Clone, Copy, PartialEq, Eq)]
+struct FileStamp {
+    modified: Option<SystemTime>,
+    len: u64,
+}
+
+impl FileStamp {
+    fn of(path: &Path) -> Option<Self> {
+        let metadata = std::fs::metadata(path).ok()?;
+        Some(FileStamp {
+            modified: metadata.modified().ok(),
+            len: metadata.len(),
+        })
+    }
+}
+
+/// Cached content of a file other than the main source. Kept across
+/// compilations so unchanged files aren't read and parsed again every time,
+/// and revalidated against the file's modification time and size once per
+/// compilation. Cloning a slot is cheap, as its contents are shared.
+#[derive(Clone)]
+struct FileSlot {
+    id: FileId,
+    path: Option<FileResult<PathBuf>>,
+    stamp: Option<FileStamp>,
+    checked: bool,
+    bytes: Option<FileResult<Bytes>>,
+    source: Option<FileResult<Source>>,
+    source_stale: bool,
+    reads: usize,
+}
+
+impl FileSlot {
+    fn new(id: FileId) -> Self {
+        Self {
+            id,
+            path: None,
+            stamp: None,
+            checked: false,
+            bytes: None,
+            source: None,
+            source_stale: false,
+            reads: 0,
+        }
+    }
+
+    fn revalidate(&mut self, path: FileResult<PathBuf>) {
+        let stamp = path.as_ref().ok().and_then(|path| FileStamp::of(path));
+
+        // Files that can't be stat'ed are never cached, there is probably an
+        // error to report about them anyway.
+        let prev_path = self.path.as_ref().and_then(|path| path.as_ref().ok());
+        let unchanged = stamp.is_some() && stamp == self.stamp && prev_path == path.as_ref().ok();
+
+        if !unchanged {
+            self.path = Some(path);
+            self.stamp = stamp;
+            self.bytes = None;
+            self.source_stale = true;
+        }
+    }
+
+    fn bytes(&mut self) -> FileResult<Bytes> {
+        if let Some(bytes) = &self.bytes {
+            return bytes.clone();
+        }
+
+        let path = self.path.clone().expect("file slot used before validation");
+        self.reads += 1;
+
+        let bytes = path.and_then(|path| {
+            if path.is_dir() {
+                return Err(FileError::IsDirectory);
+            }
+            std::fs::read(&path)
+                .map(Bytes::new)
+                .map_err(|err| FileError::from_io(err, &path))
+        });
+
+        self.bytes = Some(bytes.clone());
+        bytes
+    }
+
+    fn source(&mut self) -> FileResult<Source> {
+        if !self.source_stale {
+            if let Some(source) = &self.source {
+                return source.clone();
+            }
+        }
+
+        let bytes = self.bytes()?;
+        let text = std::str::from_utf8(&bytes).map_err(|_| FileError::InvalidUtf8);
+
+        // Replacing the text of the previous source instead of creating a new
+        // one lets Typst reparse incrementally, keeping unchanged spans stable.
+        let source = text.map(|text| match &mut self.source {
+            Some(Ok(prev)) => {
+                prev.replace(text);
+                prev.clone()
+            }
+            _ => Source::new(self.id, text.to_string()),
+        });
+
+        self.source = Some(source.clone());
+        self.source_stale = false;
+        source
     }
 }
 
@@ -182,13 +447,13 @@ impl typst::World for KatvanWorld<'_> {
             return Ok(self.source.clone());
         }
 
-        let bytes = self.get_file_content(id)?;
-        let text = String::from_utf8(bytes)?;
-        Ok(Source::new(id, text))
+        self.overlays
+            .source(id, || self.with_file_slot(id, |slot| slot.source()))
     }
 
     fn file(&self, id: FileId) -> FileResult<Bytes> {
-        self.get_file_content(id).map(Bytes::new)
+        self.overlays
+            .bytes(id, || self.with_file_slot(id, |slot| slot.bytes()))
     }
 
     fn book(&self) -> &LazyHash<FontBook> {
@@ -304,3 +569,55 @@ impl<'a> PackageManagerWrapper<'a> {
         }
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn file_id(path: &Path) -> FileId {
+        let path = VirtualPath::virtualize(&extract_path_prefix(path), path).unwrap();
+        RootedPath::new(VirtualRoot::Project, path).intern()
+    }
+
+    fn source_text(overlays: &Overlays, slot: &mut FileSlot) -> String {
+        overlays
+            .source(slot.id, || slot.source())
+            .unwrap()
+            .text()
+            .to_string()
+    }
+
+    #[test]
+    fn test_overlays() {
+        let dir = std::env::temp_dir().join(format!("katvan-overlays-{}", std::process::id()));
+        std::fs::create_dir_all(&dir).unwrap();
+
+        let path = dir.join("chapter.typ");
+        std::fs::write(&path, "On disk").unwrap();
+
+        let id = file_id(&path);
+        let mut slot = FileSlot::new(id);
+        slot.revalidate(Ok(path.clone()));
+
+        let mut overlays = Overlays::default();
+        assert_eq!(source_text(&overlays, &mut slot), "On disk");
+        assert!(!overlays.edit(id, [(0, 2, "In")]));
+
+        // The overlay wins over the file on disk
+        overlays.set(id, "In memory");
+        assert_eq!(source_text(&overlays, &mut slot), "In memory");
+
+        // Edits are applied to the overlay
+        assert!(overlays.edit(id, [(3, 9, "an"), (5, 5, " editor")]));
+        assert_eq!(source_text(&overlays, &mut slot), "In an editor");
+
+        let bytes = overlays.bytes(id, || slot.bytes()).unwrap();
+        assert_eq!(&bytes[..], b"In an editor");
+
+        // Closing goes back to the file on disk
+        overlays.close(id);
+        assert_eq!(source_text(&overlays, &mut slot), "On disk");
+
+        std::fs::remove_dir_all(&dir).unwrap();
+    }
+}
@@ -22,12 +22,20 @@
 static constexpr QLatin1StringView SETTING_ALLOW_PREVIEW_PACKAGES("compiler/allow-preview-packages");
 static constexpr QLatin1StringView SETTING_ENABLE_A11Y_EXTRAS("compiler/enable-a11y-extras");
 static constexpr QLatin1StringView SETTING_ALLOWED_PATHS = QLatin1StringView("compiler/allowedPaths");
+static constexpr QLatin1StringView SETTING_PREVIEW_DELAY("compiler/preview-delay");
+static constexpr QLatin1StringView SETTING_CACHE_MAX_AGE("compiler/cache-max-age");
+static constexpr QLatin1StringView SETTING_CACHE_MEMORY_BUDGET("compiler/cache-memory-budget");
+
+static constexpr int DEFAULT_CACHE_MAX_AGE = 3;
 
 namespace katvan::typstdriver {
 
 TypstCompilerSettings::TypstCompilerSettings()
     : d_allowPreviewPackages(false)
     , d_enableA11yExtras(false)
+    , d_previewDelay(ADAPTIVE_PREVIEW_DELAY)
+    , d_cacheMaxAge(DEFAULT_CACHE_MAX_AGE)
+    , d_cacheMemoryBudget(UNLIMITED_CACHE_MEMORY)
 {
 }
 
@@ -35,6 +43,9 @@ TypstCompilerSettings::TypstCompilerSettings(const QSettings& settings)
     : d_allowPreviewPackages(settings.value(SETTING_ALLOW_PREVIEW_PACKAGES, true).toBool())
     , d_enableA11yExtras(settings.value(SETTING_ENABLE_A11Y_EXTRAS, false).toBool())
     , d_allowedPaths(settings.value(SETTING_ALLOWED_PATHS).toStringList())
+    , d_previewDelay(settings.value(SETTING_PREVIEW_DELAY, ADAPTIVE_PREVIEW_DELAY).toInt())
+    , d_cacheMaxAge(settings.value(SETTING_CACHE_MAX_AGE, DEFAULT_CACHE_MAX_AGE).toInt())
+    , d_cacheMemoryBudget(settings.value(SETTING_CACHE_MEMORY_BUDGET, UNLIMITED_CACHE_MEMORY).toInt())
 {
 }
 
@@ -43,6 +54,9 @@ void TypstCompilerSettings::save(QSettings& settings)
     settings.setValue(SETTING_ALLOW_PREVIEW_PACKAGES, d_allowPreviewPackages);
     settings.setValue(SETTING_ENABLE_A11Y_EXTRAS, d_enableA11yExtras);
     settings.setValue(SETTING_ALLOWED_PATHS, d_allowedPaths);
+    settings.setValue(SETTING_PREVIEW_DELAY, d_previewDelay);
+    settings.setValue(SETTING_CACHE_MAX_AGE, d_cacheMaxAge);
+    settings.setValue(SETTING_CACHE_MEMORY_BUDGET, d_cacheMemoryBudget);
 }
 
 }
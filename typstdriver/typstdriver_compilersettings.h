@@ -29,6 +29,18 @@ namespace katvan::typstdriver {
 
 class TYPSTDRIVER_EXPORT TypstCompilerSettings {
 public:
+    /**
+     * Value of previewDelay() meaning the delay should be derived from the
+     * durations of recent compilations.
+     */
+    static constexpr int ADAPTIVE_PREVIEW_DELAY = 0;
+
+    /**
+     * Value of cacheMemoryBudget() meaning memoized compilation results are
+     * only evicted by age.
+     */
+    static constexpr int UNLIMITED_CACHE_MEMORY = 0;
+
     TypstCompilerSettings();
     TypstCompilerSettings(const QSettings& settings);
 
@@ -37,15 +49,24 @@ public:
     bool allowPreviewPackages() const { return d_allowPreviewPackages; }
     bool enableA11yExtras() const { return d_enableA11yExtras; }
     QStringList allowedPaths() const { return d_allowedPaths; }
+    int previewDelay() const { return d_previewDelay; }
+    int cacheMaxAge() const { return d_cacheMaxAge; }
+    int cacheMemoryBudget() const { return d_cacheMemoryBudget; }
 
     void setAllowPreviewPackages(bool allow) { d_allowPreviewPackages = allow; }
     void setEnableA11yExtras(bool enable) { d_enableA11yExtras = enable; }
     void setAllowedPaths(const QStringList& allowedPaths) { d_allowedPaths = allowedPaths; }
+    void setPreviewDelay(int msecs) { d_previewDelay = msecs; }
+    void setCacheMaxAge(int compilations) { d_cacheMaxAge = compilations; }
+    void setCacheMemoryBudget(int megabytes) { d_cacheMemoryBudget = megabytes; }
 
 private:
     bool d_allowPreviewPackages;
     bool d_enableA11yExtras;
     QStringList d_allowedPaths;
+    int d_previewDelay;
+    int d_cacheMaxAge;
+    int d_cacheMemoryBudget;
 };
 
 }
@@ -24,11 +24,22 @@
 
 #include <QDateTime>
 #include <QDir>
+#include <QElapsedTimer>
 #include <QFileInfo>
+#include <QMultiHash>
+#include <QMutex>
+#include <QPainter>
+#include <QPainterPath>
+#include <QRawFont>
+#include <QThread>
+#include <QThreadPool>
 #include <QTimeZone>
 
 #include <algorithm>
+#include <atomic>
+#include <memory>
 #include <optional>
+#include <vector>
 
 namespace katvan::typstdriver {
 
@@ -38,6 +49,13 @@ static rust::String qstringToRust(const QString& str)
     return rust::String { data.constData(), static_cast<size_t>(data.size()) };
 }
 
+// Borrows the given UTF-8 data without copying it; it must outlive the
+// returned string slice.
+static rust::Str utf8ToRustStr(const QByteArray& data)
+{
+    return rust::Str { data.constData(), static_cast<size_t>(data.size()) };
+}
+
 struct Engine::EnginePrivate
 {
     EnginePrivate(Engine* q, Logger* logger, PackageManager* packageManager, QString fileRoot)
@@ -45,7 +63,13 @@ struct Engine::EnginePrivate
         , innerPackageManager(*packageManager)
         , engine()
         , fileRoot(fileRoot)
+        , renderPool(new QThreadPool(q))
+        , documentGeneration(0)
+        , fontsSize(0)
+        , fontsGeneration(0)
     {
+        // One core is left for the engine's own thread
+        renderPool->setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));
     }
 
     LoggerProxy innerLogger;
@@ -53,6 +77,31 @@ struct Engine::EnginePrivate
     std::optional<rust::Box<EngineImpl>> engine;
     QString fileRoot;
     QByteArray pdfBuffer;
+
+    QThreadPool* renderPool;
+    quint64 documentGeneration;
+
+    // Page renders given to the render pool, for cancelling them
+    struct PageRender
+    {
+        qreal pointSize;
+        std::shared_ptr<std::atomic_bool> cancelled;
+    };
+    QMutex pageRendersLock;
+    QMultiHash<int, PageRender> pageRenders;
+
+    // Data of fonts already received with page display lists, by font ID
+    QMutex fontsLock;
+    QHash<quint64, QByteArray> fonts;
+    qsizetype fontsSize;
+    quint64 fontsGeneration; // Bumped whenever fonts are dropped
+
+    void clearFonts()
+    {
+        fonts.clear();
+        fontsSize = 0;
+        fontsGeneration++;
+    }
 };
 
 Engine::Engine(const QString& filePath, Logger* logger, PackageManager* packageManager, QObject* parent)
@@ -69,6 +118,9 @@ Engine::Engine(const QString& filePath, Logger* logger, PackageManager* packageM
 
 Engine::~Engine()
 {
+    // Render jobs refer back to the engine to deliver their results
+    d_ptr->renderPool->clear();
+    d_ptr->renderPool->waitForDone();
 }
 
 QString Engine::typstVersion()
@@ -77,6 +129,17 @@ QString Engine::typstVersion()
     return QString::fromUtf8(version.data(), version.size());
 }
 
+void Engine::cancelPageRenders(int page, qreal keepPointSize)
+{
+    QMutexLocker locker { &d_ptr->pageRendersLock };
+
+    for (auto it = d_ptr->pageRenders.constFind(page); it != d_ptr->pageRenders.cend() && it.key() == page; ++it) {
+        if (it->pointSize != keepPointSize) {
+            it->cancelled->store(true);
+        }
+    }
+}
+
 void Engine::init()
 {
     if (d_ptr->engine.has_value()) {
@@ -96,17 +159,52 @@ void Engine::setSource(const QString& text)
 {
     Q_ASSERT(d_ptr->engine.has_value());
 
-    d_ptr->engine.value()->set_source(qstringToRust(text));
+    QByteArray data = text.toUtf8();
+    d_ptr->engine.value()->set_source(utf8ToRustStr(data));
 }
 
-void Engine::applyContentEdit(int from, int to, const QString& text)
+void Engine::setFileSource(const QString& filePath, const QString& text)
 {
     Q_ASSERT(d_ptr->engine.has_value());
 
-    d_ptr->engine.value()->apply_content_edit(
-        static_cast<size_t>(from),
-        static_cast<size_t>(to),
-        qstringToRust(text));
+    QByteArray path = QDir::toNativeSeparators(filePath).toUtf8();
+    QByteArray data = text.toUtf8();
+    d_ptr->engine.value()->set_file_source(utf8ToRustStr(path), utf8ToRustStr(data));
+}
+
+void Engine::applyContentEdits(const QString& filePath, const QList<SourceEdit>& edits)
+{
+    Q_ASSERT(d_ptr->engine.has_value());
+
+    // Pass the whole batch in a single call, with the inserted texts
+    // concatenated into one buffer.
+    QByteArray text;
+    std::vector<ContentEdit> contentEdits;
+    contentEdits.reserve(edits.size());
+
+    for (const SourceEdit& edit : edits) {
+        qsizetype offset = text.size();
+        text.append(edit.text.toUtf8());
+
+        contentEdits.push_back(ContentEdit {
+            static_cast<size_t>(edit.from),
+            static_cast<size_t>(edit.to),
+            static_cast<size_t>(text.size() - offset)
+        });
+    }
+
+    QByteArray path = QDir::toNativeSeparators(filePath).toUtf8();
+    d_ptr->engine.value()->apply_content_edits(
+        utf8ToRustStr(path),
+        rust::Slice<const ContentEdit> { contentEdits.data(), contentEdits.size() },
+        utf8ToRustStr(text));
+}
+
+void Engine::closeFile(const QString& filePath)
+{
+    Q_ASSERT(d_ptr->engine.has_value());
+
+    d_ptr->engine.value()->close_file(qstringToRust(QDir::toNativeSeparators(filePath)));
 }
 
 void Engine::compile()
@@ -116,8 +214,12 @@ void Engine::compile()
     QString now = QDateTime::currentDateTime(QTimeZone::systemTimeZone()).toString(Qt::ISODate);
 
     rust::Vec<PreviewPageDataInternal> pages = d_ptr->engine.value()->compile(qstringToRust(now));
+
+    QElapsedTimer marshalingTimer;
+    marshalingTimer.start();
+
+    QList<PreviewPageData> result;
     if (!pages.empty()) {
-        QList<PreviewPageData> result;
         result.reserve(pages.size());
         for (PreviewPageDataInternal& data : pages) {
             result.append(PreviewPageData {
@@ -126,7 +228,29 @@ void Engine::compile()
                 data.fingerprint
             });
         }
-
+    }
+    qint64 marshalingNsecs = marshalingTimer.nsecsElapsed();
+
+    CompileStats stats = d_ptr->engine.value()->take_compile_stats();
+    Q_EMIT compilationStatisticsReady(CompileStatistics {
+        stats.success,
+        static_cast<int>(stats.pages),
+        static_cast<int>(stats.edits),
+        static_cast<qint64>(stats.edits_nsecs),
+        static_cast<qint64>(stats.typst_nsecs),
+        static_cast<qint64>(stats.evict_nsecs),
+        static_cast<qint64>(stats.fingerprint_nsecs),
+        marshalingNsecs,
+        static_cast<int>(stats.files_cached),
+        static_cast<int>(stats.files_read),
+        static_cast<int>(stats.cache_max_age),
+        static_cast<qint64>(stats.resident_bytes)
+    });
+
+    if (!result.isEmpty()) {
+        // Renders still running for the previous result must not be
+        // delivered as if they belong to the new one.
+        d_ptr->documentGeneration++;
         Q_EMIT previewReady(result);
     }
     Q_EMIT compilationFinished();
@@ -138,27 +262,343 @@ static void cleanupBuffer(void* buffer)
     delete buf;
 }
 
-void Engine::renderPage(int page, qreal pointSize)
+static QImage renderedPageToImage(RenderedPage result)
+{
+    rust::Vec<uint8_t>* buffer = new rust::Vec<uint8_t>(std::move(result.buffer));
+
+    QImage image {
+        buffer->data(),
+        static_cast<int>(result.width_px),
+        static_cast<int>(result.height_px),
+        QImage::Format_RGBA8888_Premultiplied, // Per tiny-skia's documentation
+        cleanupBuffer,
+        buffer
+    };
+
+    // This is called on render workers. Convert to the format Qt's raster
+    // engine paints natively here, rather than on every paint of the image
+    // on the GUI thread. The converted copy owns its data, so the Rust
+    // buffer is released as soon as the original goes out of scope.
+    return image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+}
+
+void Engine::renderPage(int page, qreal pointSize, bool invertColors)
 {
     Q_ASSERT(d_ptr->engine.has_value());
 
+    std::shared_ptr<rust::Box<RenderSnapshot>> snapshot;
     try {
-        RenderedPage result = d_ptr->engine.value()->render_page(page, pointSize);
-        rust::Vec<uint8_t>* buffer = new rust::Vec<uint8_t>(std::move(result.buffer));
-
-        QImage image {
-            buffer->data(),
-            static_cast<int>(result.width_px),
-            static_cast<int>(result.height_px),
-            QImage::Format_RGBA8888_Premultiplied, // Per tiny-skia's documentation
-            cleanupBuffer,
-            buffer
-        };
-        Q_EMIT pageRendered(page, image);
+        snapshot = std::make_shared<rust::Box<RenderSnapshot>>(d_ptr->engine.value()->render_snapshot());
     }
     catch (rust::Error& e) {
         qWarning() << "Error rendering page" << page << ":" << e.what();
+        return;
+    }
+
+    auto cancelled = std::make_shared<std::atomic_bool>(false);
+    {
+        QMutexLocker locker { &d_ptr->pageRendersLock };
+        d_ptr->pageRenders.insert(page, EnginePrivate::PageRender { pointSize, cancelled });
     }
+
+    // Rasterizing only needs the compiled document, which the snapshot keeps
+    // alive on its own. Do it on the render pool, so several pages render in
+    // parallel and the engine is free to handle other requests meanwhile.
+    quint64 generation = d_ptr->documentGeneration;
+    d_ptr->renderPool->start([this, snapshot, cancelled, generation, page, pointSize, invertColors]() {
+        if (!cancelled->load()) {
+            try {
+                QImage image = renderedPageToImage((*snapshot)->render_page(page, pointSize, invertColors));
+
+                // Deliver from the engine's thread, so the result is ordered
+                // relative to previewReady for any compilation done meanwhile.
+                QMetaObject::invokeMethod(this, [this, cancelled, generation, page, pointSize, invertColors, image]() {
+                    if (generation == d_ptr->documentGeneration && !cancelled->load()) {
+                        Q_EMIT pageRendered(page, pointSize, invertColors, image);
+                    }
+                });
+            }
+            catch (rust::Error& e) {
+                qWarning() << "Error rendering page" << page << ":" << e.what();
+            }
+        }
+
+        QMutexLocker locker { &d_ptr->pageRendersLock };
+        for (auto it = d_ptr->pageRenders.find(page); it != d_ptr->pageRenders.end() && it.key() == page; ++it) {
+            if (it->cancelled == cancelled) {
+                d_ptr->pageRenders.erase(it);
+                break;
+            }
+        }
+    });
+}
+
+void Engine::renderTile(int page, qreal pointSize, QRect tile, bool invertColors)
+{
+    Q_ASSERT(d_ptr->engine.has_value());
+
+    std::shared_ptr<rust::Box<RenderSnapshot>> snapshot;
+    try {
+        snapshot = std::make_shared<rust::Box<RenderSnapshot>>(d_ptr->engine.value()->render_snapshot());
+    }
+    catch (rust::Error& e) {
+        qWarning() << "Error rendering tile" << tile << "of page" << page << ":" << e.what();
+        return;
+    }
+
+    // Same as for whole pages
+    quint64 generation = d_ptr->documentGeneration;
+    d_ptr->renderPool->start([this, snapshot, generation, page, pointSize, tile, invertColors]() {
+        try {
+            QImage image = renderedPageToImage((*snapshot)->render_tile(
+                page,
+                pointSize,
+                static_cast<uint32_t>(tile.x()),
+                static_cast<uint32_t>(tile.y()),
+                static_cast<uint32_t>(tile.width()),
+                static_cast<uint32_t>(tile.height()),
+                invertColors));
+
+            QMetaObject::invokeMethod(this, [this, generation, page, pointSize, tile, invertColors, image]() {
+                if (generation == d_ptr->documentGeneration) {
+                    Q_EMIT tileRendered(page, pointSize, tile, invertColors, image);
+                }
+            });
+        }
+        catch (rust::Error& e) {
+            qWarning() << "Error rendering tile" << tile << "of page" << page << ":" << e.what();
+        }
+    });
+}
+
+// Must match the verbs in display.rs
+static constexpr uint8_t PATH_VERB_MOVE = 0;
+static constexpr uint8_t PATH_VERB_LINE = 1;
+static constexpr uint8_t PATH_VERB_CUBIC = 2;
+static constexpr uint8_t PATH_VERB_CLOSE = 3;
+
+// Glyph outlines are extracted at this size and scaled for each text item
+static constexpr qreal GLYPH_OUTLINE_SIZE = 1000.0;
+
+// Upper bound on the data of fonts kept for page display lists, in bytes
+static constexpr qsizetype MAX_PICTURE_FONTS_SIZE = 64 * 1024 * 1024;
+
+static QPainterPath displayPathToPainterPath(const DisplayList& list, size_t verbStart, size_t verbCount, size_t pointStart)
+{
+    QPainterPath path;
+    const double* points = list.path_points.data() + pointStart;
+
+    for (size_t i = verbStart; i < verbStart + verbCount; i++) {
+        switch (list.path_verbs[i]) {
+        case PATH_VERB_MOVE:
+            path.moveTo(points[0], points[1]);
+            points += 2;
+            break;
+        case PATH_VERB_LINE:
+            path.lineTo(points[0], points[1]);
+            points += 2;
+            break;
+        case PATH_VERB_CUBIC:
+            path.cubicTo(points[0], points[1], points[2], points[3], points[4], points[5]);
+            points += 6;
+            break;
+        case PATH_VERB_CLOSE:
+            path.closeSubpath();
+            break;
+        }
+    }
+    return path;
+}
+
+static QPen displayItemPen(const DisplayItem& item)
+{
+    QPen pen { QColor::fromRgba(item.stroke_argb), item.stroke_width };
+    pen.setCapStyle(item.stroke_cap == 1 ? Qt::RoundCap : item.stroke_cap == 2 ? Qt::SquareCap : Qt::FlatCap);
+    pen.setJoinStyle(item.stroke_join == 1 ? Qt::RoundJoin : item.stroke_join == 2 ? Qt::BevelJoin : Qt::SvgMiterJoin);
+
+    // Typst's miter limit is relative to the stroke's width, Qt's to half of it
+    pen.setMiterLimit(item.miter_limit / 2);
+    return pen;
+}
+
+/**
+ * Replay a page's display list into a picture, in page points. Returns a
+ * null picture if the list can't be represented as is.
+ */
+static QPicture displayListToPicture(const DisplayList& list, const QHash<quint64, QByteArray>& fontData, bool invertColors)
+{
+    if (!list.complete) {
+        return QPicture();
+    }
+
+    QHash<quint64, QRawFont> fonts;
+    QHash<std::pair<quint64, quint16>, QPainterPath> glyphOutlines;
+
+    QPicture picture;
+    QPainter painter(&picture);
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    painter.setPen(Qt::NoPen);
+
+    // Everything is clipped to the page, and clip paths of items are only
+    // ever intersected with that, so content never spills out of the page
+    // however the picture is drawn
+    QRectF pageRect { 0, 0, list.width_pts, list.height_pts };
+    painter.setClipRect(pageRect);
+
+    if (qAlpha(list.background_argb) > 0) {
+        painter.fillRect(pageRect, QColor::fromRgba(list.background_argb));
+    }
+
+    size_t currentClip = 0;
+    for (const DisplayItem& item : list.items) {
+        if (item.clip != currentClip) {
+            if (currentClip > 0) {
+                painter.restore();
+            }
+            if (item.clip > 0) {
+                const DisplayPath& clip = list.clips[item.clip - 1];
+                painter.save();
+                painter.resetTransform();
+                painter.setClipPath(displayPathToPainterPath(list, clip.verb_start, clip.verb_count, clip.point_start), Qt::IntersectClip);
+            }
+            currentClip = item.clip;
+        }
+
+        painter.setTransform(QTransform(item.m11, item.m12, item.m21, item.m22, item.dx, item.dy));
+
+        if (item.kind == DisplayItemKind::Glyphs) {
+            auto fontIt = fonts.find(item.font_id);
+            if (fontIt == fonts.end()) {
+                QRawFont font { fontData.value(item.font_id), GLYPH_OUTLINE_SIZE, QFont::PreferNoHinting };
+                fontIt = fonts.insert(item.font_id, font);
+            }
+            if (!fontIt->isValid()) {
+                return QPicture();
+            }
+
+            QPainterPath run;
+            qreal scale = item.font_size / GLYPH_OUTLINE_SIZE;
+            for (size_t i = item.start; i < item.start + item.count; i++) {
+                quint16 glyph = list.glyph_ids[i];
+
+                auto outlineIt = glyphOutlines.find({ item.font_id, glyph });
+                if (outlineIt == glyphOutlines.end()) {
+                    outlineIt = glyphOutlines.insert({ item.font_id, glyph }, fontIt->pathForGlyph(glyph));
+                }
+                run.addPath(QTransform(scale, 0, 0, scale, list.glyph_positions[2 * i], list.glyph_positions[2 * i + 1]).map(*outlineIt));
+            }
+            painter.fillPath(run, QColor::fromRgba(item.fill_argb));
+        }
+        else if (item.kind == DisplayItemKind::Path) {
+            QPainterPath path = displayPathToPainterPath(list, item.start, item.count, item.point_start);
+            path.setFillRule(item.even_odd ? Qt::OddEvenFill : Qt::WindingFill);
+
+            if (qAlpha(item.fill_argb) > 0) {
+                painter.fillPath(path, QColor::fromRgba(item.fill_argb));
+            }
+            // A zero width pen would be a cosmetic one for Qt
+            if (qAlpha(item.stroke_argb) > 0 && item.stroke_width > 0) {
+                painter.strokePath(path, displayItemPen(item));
+            }
+        }
+        else if (item.kind == DisplayItemKind::Image) {
+            const rust::Vec<uint8_t>& data = list.images[item.start].data;
+            QImage image = QImage::fromData(QByteArrayView(data.data(), data.size()));
+            if (image.isNull()) {
+                return QPicture();
+            }
+
+            if (invertColors) {
+                image.convertTo(QImage::Format_RGBA8888_Premultiplied);
+                invert_lightness(rust::Slice<uint8_t> { image.bits(), static_cast<size_t>(image.sizeInBytes()) });
+            }
+            image.convertTo(QImage::Format_ARGB32_Premultiplied);
+            painter.drawImage(QRectF(0, 0, item.width, item.height), image);
+        }
+    }
+
+    if (currentClip > 0) {
+        painter.restore();
+    }
+    painter.end();
+    return picture;
+}
+
+void Engine::renderPagePicture(int page, bool invertColors)
+{
+    Q_ASSERT(d_ptr->engine.has_value());
+
+    std::shared_ptr<rust::Box<RenderSnapshot>> snapshot;
+    try {
+        snapshot = std::make_shared<rust::Box<RenderSnapshot>>(d_ptr->engine.value()->render_snapshot());
+    }
+    catch (rust::Error& e) {
+        qWarning() << "Error exporting display list of page" << page << ":" << e.what();
+        return;
+    }
+
+    quint64 generation = d_ptr->documentGeneration;
+    d_ptr->renderPool->start([this, snapshot, generation, page, invertColors]() {
+        std::vector<uint64_t> knownFonts;
+        quint64 fontsGeneration;
+        {
+            // Past the limit, fonts are dropped and sent again with the
+            // display lists of pages that still use them
+            QMutexLocker locker { &d_ptr->fontsLock };
+            if (d_ptr->fontsSize > MAX_PICTURE_FONTS_SIZE) {
+                d_ptr->clearFonts();
+            }
+            fontsGeneration = d_ptr->fontsGeneration;
+            for (auto it = d_ptr->fonts.cbegin(); it != d_ptr->fonts.cend(); ++it) {
+                knownFonts.push_back(it.key());
+            }
+        }
+
+        try {
+            DisplayList list = (*snapshot)->display_list(
+                page,
+                rust::Slice<const uint64_t> { knownFonts.data(), knownFonts.size() },
+                invertColors);
+
+            QHash<quint64, QByteArray> fontData;
+            {
+                QMutexLocker locker { &d_ptr->fontsLock };
+                if (d_ptr->fontsGeneration != fontsGeneration) {
+                    // Fonts the list only refers to by ID were dropped while
+                    // it was built, so build it again with all of its fonts
+                    locker.unlock();
+                    list = (*snapshot)->display_list(page, rust::Slice<const uint64_t> {}, invertColors);
+                    locker.relock();
+                }
+
+                for (const DisplayFont& font : list.fonts) {
+                    if (!d_ptr->fonts.contains(font.id)) {
+                        d_ptr->fonts.insert(font.id, QByteArray(reinterpret_cast<const char*>(font.data.data()), font.data.size()));
+                        d_ptr->fontsSize += font.data.size();
+                    }
+                }
+                fontData = d_ptr->fonts;
+            }
+
+            QPicture picture = displayListToPicture(list, fontData, invertColors);
+
+            QMetaObject::invokeMethod(this, [this, generation, page, invertColors, picture]() {
+                if (generation == d_ptr->documentGeneration) {
+                    Q_EMIT pagePictureRendered(page, invertColors, picture);
+                }
+            });
+        }
+        catch (rust::Error& e) {
+            qWarning() << "Error exporting display list of page" << page << ":" << e.what();
+        }
+    });
+}
+
+void Engine::discardPictureFonts()
+{
+    QMutexLocker locker { &d_ptr->fontsLock };
+    d_ptr->clearFonts();
 }
 
 void Engine::exportToPdf(const QString& outputFile, const QString& pdfVersion, const QString& pdfaStandard, bool tagged)
@@ -385,6 +825,9 @@ void Engine::applySettings(const TypstCompilerSettings& settings)
     Q_ASSERT(d_ptr->engine.has_value());
 
     d_ptr->engine.value()->set_compiler_flags(settings.enableA11yExtras());
+    d_ptr->engine.value()->set_cache_policy(
+        static_cast<size_t>(qMax(1, settings.cacheMaxAge())),
+        static_cast<uint64_t>(qMax(0, settings.cacheMemoryBudget())));
 
     const QStringList allowedPaths = settings.allowedPaths();
 
@@ -22,6 +22,8 @@
 #include <QByteArray>
 #include <QImage>
 #include <QObject>
+#include <QPicture>
+#include <QRect>
 #include <QSize>
 #include <QString>
 #include <QUrl>
@@ -43,6 +45,32 @@ struct TYPSTDRIVER_EXPORT PreviewPageData
     quint64 fingerprint;
 };
 
+struct TYPSTDRIVER_EXPORT SourceEdit
+{
+    int from;
+    int to;
+    QString text;
+};
+
+/**
+ * Timing breakdown and cache statistics of a single compilation.
+ */
+struct TYPSTDRIVER_EXPORT CompileStatistics
+{
+    bool success = false;
+    int pages = 0;
+    int edits = 0;
+    qint64 editsNsecs = 0;       // Applying edits since the previous compilation
+    qint64 typstNsecs = 0;       // Evaluation, layout and introspection
+    qint64 evictionNsecs = 0;    // Evicting old entries from Typst's memoization cache
+    qint64 fingerprintNsecs = 0; // Fingerprinting of pages for the previewer
+    qint64 marshalingNsecs = 0;  // Converting page data for the Qt side
+    int filesCached = 0;
+    int filesRead = 0;
+    int cacheMaxAge = 0;         // Age used for evicting memoized results, lowered when over budget
+    qint64 residentBytes = 0;    // Process memory after eviction, if known
+};
+
 using DocumentLabel = std::tuple<QString, int, int>;
 
 class TYPSTDRIVER_EXPORT Engine : public QObject
@@ -55,11 +83,22 @@ public:
 
     static QString typstVersion();
 
+    /**
+     * Drop renders of the given page at other point sizes than the one given,
+     * that were started but whose results were not delivered yet. Renders
+     * that already started rasterizing are still completed, but their result
+     * is discarded. Unlike the slots, this may be called from any thread.
+     */
+    void cancelPageRenders(int page, qreal keepPointSize);
+
 signals:
     void initialized();
     void compilationFinished();
+    void compilationStatisticsReady(katvan::typstdriver::CompileStatistics statistics);
     void previewReady(QList<katvan::typstdriver::PreviewPageData> pages);
-    void pageRendered(int page, QImage renderedPage);
+    void pageRendered(int page, qreal pointSize, bool invertColors, QImage renderedPage);
+    void tileRendered(int page, qreal pointSize, QRect tile, bool invertColors, QImage renderedTile);
+    void pagePictureRendered(int page, bool invertColors, QPicture picture);
     void exportFinished(bool success);
     void jumpToPreview(int page, QPointF pos);
     void jumpToEditor(int line, int column);
@@ -72,9 +111,14 @@ signals:
 public slots:
     void init();
     void setSource(const QString& text);
-    void applyContentEdit(int from, int to, const QString& text);
+    void setFileSource(const QString& filePath, const QString& text);
+    void applyContentEdits(const QString& filePath, const QList<katvan::typstdriver::SourceEdit>& edits);
+    void closeFile(const QString& filePath);
     void compile();
-    void renderPage(int page, qreal pointSize);
+    void renderPage(int page, qreal pointSize, bool invertColors);
+    void renderTile(int page, qreal pointSize, QRect tile, bool invertColors);
+    void renderPagePicture(int page, bool invertColors);
+    void discardPictureFonts();
     void exportToPdf(const QString& outputFile, const QString& pdfVersion, const QString& pdfaStandard, bool tagged);
     void exportToPng(const QString& outputFile, int dpi);
     void exportToPngMulti(const QString& outputDir, const QString& filePattern, int dpi);
@@ -97,3 +141,4 @@ private:
 }
 
 Q_DECLARE_METATYPE(katvan::typstdriver::PreviewPageData)
+Q_DECLARE_METATYPE(katvan::typstdriver::CompileStatistics)